@@ -8,6 +8,24 @@
 #include "Commands.h"
 #include <time.h>
 #include <utime.h>
+#include <fstream>
+#include <errno.h>
+#include <signal.h>
+#include <algorithm>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <fnmatch.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <linux/perf_event.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
@@ -85,7 +103,7 @@ void _removeBackgroundSign(char *cmd_line)
   cmd_line[str.find_last_not_of(WHITESPACE, idx) + 1] = 0;
 }
 
-Command::Command(const char *cmd_line, bool built_in) 
+Command::Command(const char *cmd_line, bool built_in) : c_cancelled(false), c_in_fd(STDIN_FILENO), c_out_fd(STDOUT_FILENO), c_err_fd(STDERR_FILENO), c_owns_fds(false), c_start_time(0), c_pidfd(-1)
 {
 
   if (cmd_line == nullptr)
@@ -102,7 +120,14 @@ Command::Command(const char *cmd_line, bool built_in)
       _removeBackgroundSign(non_const_cmd_line);
     }
     
-    c_args=new char*[COMMAND_MAX_ARGS];
+    int num_of_words = 0; // bulk built-ins (touch of many files) may need more than COMMAND_MAX_ARGS
+    std::istringstream words(non_const_cmd_line);
+    for (std::string word; words >> word;)
+    {
+      num_of_words++;
+    }
+    c_args=new char*[std::max(COMMAND_MAX_ARGS, num_of_words + 1)];
+    c_args[0] = nullptr;
     c_num_of_args = _parseCommandLine(non_const_cmd_line,c_args);
     delete[] non_const_cmd_line;
   }
@@ -110,6 +135,16 @@ Command::Command(const char *cmd_line, bool built_in)
 
 Command::~Command()
 {
+  setPidFd(-1);
+  if (c_owns_fds)
+  {
+    int fds[3] = {c_in_fd, c_out_fd, c_err_fd};
+    for (int i = 0; i < 3; i++)
+    {
+      if (fds[i] != i && close(fds[i]) == -1)
+        perror("smash error: close failed");
+    }
+  }
   for (int i=0; i< c_num_of_args; i++){
     if (c_args[i] != nullptr){
       free (c_args[i]);
@@ -123,6 +158,30 @@ std::string Command::getCmdLine()
   return c_cmd_line; 
 } 
 
+std::string Command::getJobLine()
+{
+  return c_job_line.empty() ? c_cmd_line : c_job_line;
+}
+
+void Command::setJobLine(const std::string& job_line)
+{
+  c_job_line = job_line;
+}
+
+void Command::setPidFd(int pidfd)
+{
+  if (c_pidfd != -1)
+    close(c_pidfd);
+  c_pidfd = pidfd;
+}
+
+int Command::takePidFd()
+{
+  int pidfd = c_pidfd;
+  c_pidfd = -1;
+  return pidfd;
+}
+
 pid_t Command::getPid() const
 {
   return c_pid;
@@ -133,6 +192,111 @@ void Command::setPid(pid_t pid)
   c_pid = pid; 
 }
 
+void Command::cancel()
+{
+  c_cancelled = true;
+}
+
+bool Command::isCancelled() const
+{
+  return c_cancelled;
+}
+
+int Command::getInFd() const
+{
+  return c_in_fd;
+}
+
+void Command::setInFd(int fd)
+{
+  c_in_fd = fd;
+}
+
+int Command::getOutFd() const
+{
+  return c_out_fd;
+}
+
+void Command::setOutFd(int fd)
+{
+  c_out_fd = fd;
+}
+
+int Command::getErrFd() const
+{
+  return c_err_fd;
+}
+
+void Command::setErrFd(int fd)
+{
+  c_err_fd = fd;
+}
+
+void Command::setOwnsFds(bool owns_fds)
+{
+  c_owns_fds = owns_fds;
+}
+
+double Command::getStartTime() const
+{
+  return c_start_time;
+}
+
+void Command::setStartTime(double start_time)
+{
+  c_start_time = start_time;
+}
+
+static double _monotonicSeconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// user / sys time that pool threads spent on work the calling thread handed them (the items of
+// its parallelFor calls, its in-process pipe stages), which its own RUSAGE_THREAD misses
+static thread_local struct rusage t_pool_usage;
+
+static void _addPoolUsage(const struct rusage& usage)
+{
+  timeradd(&t_pool_usage.ru_utime, &usage.ru_utime, &t_pool_usage.ru_utime);
+  timeradd(&t_pool_usage.ru_stime, &usage.ru_stime, &t_pool_usage.ru_stime);
+}
+
+// writes the whole buffer, retrying short writes and EINTR
+static bool _writeAll(int fd, const char* buf, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t res = write(fd, buf, len);
+    if (res == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    buf += res;
+    len -= res;
+  }
+  return true;
+}
+
+bool Command::writeOut(const std::string& str)
+{
+  if (c_out_fd == STDOUT_FILENO)
+  {
+    std::cout.flush(); // keep the order with whatever was already printed through cout
+  }
+  if (!_writeAll(c_out_fd, str.data(), str.size()))
+  {
+    if (errno != EPIPE) // the reader of the pipe is gone, nothing to report
+      perror("smash error: write failed");
+    return false;
+  }
+  return true;
+}
+
 bool Command::isANumber(const char* str)
 { 
   for (unsigned int i = (str[0] == '-') ? 1 : 0 ; i < strlen(str); i++)
@@ -145,6 +309,208 @@ bool Command::isANumber(const char* str)
 
 BuiltInCommand::BuiltInCommand(const char *cmd_line) : Command(cmd_line,true) {}
 
+bool BuiltInCommand::canRunInBackground() const
+{
+  return false;
+}
+
+bool BuiltInCommand::canRunInPipe() const
+{
+  return false;
+}
+
+/*GLOB EXPANSION***************/
+struct linux_dirent64
+{
+  ino64_t d_ino;
+  off64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+#define DIR_CACHE_MAX_DIRS 256
+#define DIR_CACHE_MIN_AGE 1 // secs - a listing changed within the mtime granularity is not trusted
+
+// reads all the entries of an open directory with raw getdents64 calls (no DIR* / readdir)
+bool _readDirEntries(int dir_fd, std::vector<DirCache::DirEntry>& entries)
+{
+  char buf[64 * 1024];
+  while (true)
+  {
+    long res = syscall(SYS_getdents64, dir_fd, buf, sizeof(buf));
+    if (res == -1 && errno == EINTR)
+      continue;
+    if (res == -1)
+      return false;
+    if (res == 0)
+      return true;
+    for (long pos = 0; pos < res;)
+    {
+      struct linux_dirent64* dirent = (struct linux_dirent64*)(buf + pos);
+      pos += dirent->d_reclen;
+      if (strcmp(dirent->d_name, ".") == 0 || strcmp(dirent->d_name, "..") == 0)
+        continue;
+      DirCache::DirEntry entry = {dirent->d_name, dirent->d_type};
+      entries.push_back(entry);
+    }
+  }
+}
+
+static bool _listingCompare(const DirCache::DirEntry& a, const DirCache::DirEntry& b)
+{
+  return a.name < b.name;
+}
+
+std::shared_ptr<const std::vector<DirCache::DirEntry> > DirCache::getEntries(const std::string& dir)
+{
+  int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1)
+    return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) == -1)
+  {
+    close(fd);
+    return nullptr;
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<std::string, Listing>::iterator it = listings.find(dir);
+    if (it != listings.end() && it->second.mtime.tv_sec == st.st_mtim.tv_sec &&
+        it->second.mtime.tv_nsec == st.st_mtim.tv_nsec && it->second.ino == st.st_ino)
+    {
+      close(fd);
+      return it->second.entries;
+    }
+  }
+
+  std::shared_ptr<std::vector<DirEntry> > entries(new std::vector<DirEntry>());
+  bool read_ok = _readDirEntries(fd, *entries);
+  close(fd);
+  if (!read_ok)
+    return nullptr;
+  std::sort(entries->begin(), entries->end(), _listingCompare);
+
+  if (time(nullptr) - st.st_mtim.tv_sec >= DIR_CACHE_MIN_AGE)
+  {
+    Listing listing;
+    listing.mtime = st.st_mtim;
+    listing.ino = st.st_ino;
+    listing.entries = entries;
+    std::lock_guard<std::mutex> guard(lock);
+    if (listings.size() >= DIR_CACHE_MAX_DIRS)
+      listings.clear();
+    listings[dir] = listing;
+  }
+  return entries;
+}
+
+void DirCache::clear()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  listings.clear();
+}
+
+static bool _hasGlobChars(const std::string& str)
+{
+  return str.find_first_of("*?[") != string::npos;
+}
+
+// expands a glob pattern (e.g. src/*/x*.c) in-process. like bash: the result is sorted, names
+// starting with '.' only match a pattern starting with '.', and a pattern matching nothing
+// (or without glob characters) expands to itself. a pattern ending in '/' only matches directories
+std::vector<std::string> _expandGlob(const std::string& pattern)
+{
+  std::vector<std::string> results;
+  if (!_hasGlobChars(pattern))
+  {
+    results.push_back(pattern);
+    return results;
+  }
+  std::vector<std::string> components;
+  std::istringstream iss(pattern);
+  for (std::string component; std::getline(iss, component, '/');)
+  {
+    if (!component.empty())
+      components.push_back(component);
+  }
+
+  bool dirs_only = components.size() > 0 && pattern[pattern.size() - 1] == '/';
+  DirCache& cache = SmallShell::getInstance().getDirCache();
+  std::vector<std::string> prefixes(1, pattern[0] == '/' ? "/" : "");
+  for (size_t c = 0; c < components.size() && !prefixes.empty(); c++)
+  {
+    const std::string& component = components[c];
+    bool last = (c == components.size() - 1);
+    std::vector<std::string> next;
+    for (size_t p = 0; p < prefixes.size(); p++)
+    {
+      if (!_hasGlobChars(component))
+      {
+        std::string path = prefixes[p] + component;
+        struct stat st;
+        if (!last)
+          next.push_back(path + "/");
+        else if (!dirs_only && lstat(path.c_str(), &st) == 0)
+          next.push_back(path);
+        else if (dirs_only && stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+          next.push_back(path + "/");
+        continue;
+      }
+      std::shared_ptr<const std::vector<DirCache::DirEntry> > entries = cache.getEntries(prefixes[p].empty() ? "." : prefixes[p]);
+      if (entries == nullptr)
+        continue;
+      for (size_t e = 0; e < entries->size(); e++)
+      {
+        const DirCache::DirEntry& entry = (*entries)[e];
+        if (fnmatch(component.c_str(), entry.name.c_str(), FNM_PERIOD) != 0)
+          continue;
+        std::string path = prefixes[p] + entry.name;
+        if (!last || dirs_only) // only directories lead to the next component, or end in '/'
+        {
+          struct stat st;
+          if (entry.type != DT_DIR && entry.type != DT_UNKNOWN && entry.type != DT_LNK)
+            continue;
+          if (entry.type != DT_DIR && (stat(path.c_str(), &st) == -1 || !S_ISDIR(st.st_mode)))
+            continue;
+          path += "/";
+        }
+        next.push_back(path);
+      }
+    }
+    prefixes.swap(next);
+  }
+  if (prefixes.empty())
+  {
+    results.push_back(pattern);
+    return results;
+  }
+  return prefixes;
+}
+
+// splits a simple command line into an argv with globs expanded. returns false, with argv
+// empty, when the line needs bash (quotes, variables, redirections, compound commands,
+// assignments, ~ ...)
+static bool _buildDirectArgv(const char* cmd_line, std::vector<std::string>& argv)
+{
+  argv.clear();
+  if (strpbrk(cmd_line, "|&;<>()$`\\\"'{}") != nullptr)
+    return false;
+  std::istringstream iss(cmd_line);
+  for (std::string word; iss >> word;)
+  {
+    if (word[0] == '~' || word[0] == '#' || (argv.empty() && (word.find('=') != string::npos || word == "!")))
+    {
+      argv.clear();
+      return false;
+    }
+    std::vector<std::string> matches = _expandGlob(word);
+    argv.insert(argv.end(), matches.begin(), matches.end());
+  }
+  return !argv.empty();
+}
+/******************GLOB EXPANSION*/
+
 /*CHPROMPT COMMAND***************/
 ChangePromptCommand::ChangePromptCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
 void ChangePromptCommand::execute()
@@ -157,22 +523,36 @@ void ChangePromptCommand::execute()
 
 /*SHOWPID COMMAND***************/
 ShowPidCommand::ShowPidCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
+bool ShowPidCommand::canRunInPipe() const
+{
+  return true;
+}
+
 void ShowPidCommand::execute()
 {
 
   SmallShell &smash = SmallShell::getInstance();
+  std::ostringstream out;
   
   if (smash.isPiped())
   {
-    std::cout << "smash pid is " << getppid() << std::endl;
-    return;
+    out << "smash pid is " << getppid() << std::endl;
+  }
+  else
+  {
+    out << "smash pid is " << getpid() << std::endl;
   }
-  std::cout << "smash pid is " << getpid() << std::endl;
+  writeOut(out.str());
 }
 /******************SHOWPID COMMAND*/
 
 /*PWD COMMAND***************/
 GetCurrDirCommand::GetCurrDirCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
+bool GetCurrDirCommand::canRunInPipe() const
+{
+  return true;
+}
+
 void GetCurrDirCommand::execute()
 {
   char buf[PATH_MAX];
@@ -181,7 +561,7 @@ void GetCurrDirCommand::execute()
     perror("getcwd failed");
     return;
   }
-  std::cout << buf << std::endl;
+  writeOut(std::string(buf) + "\n");
 }
 /******************PWD COMMAND*/
 
@@ -237,117 +617,499 @@ void ChangeDirCommand::execute()
 
 /*JOBS COMMAND***************/
 JobsCommand::JobsCommand(const char *cmd_line, JobsList* jobs) : BuiltInCommand(cmd_line), c_jobs(jobs) {}
-void JobsCommand::execute()
+bool JobsCommand::canRunInPipe() const
 {
-  c_jobs->printJobsList();
+  return true;
 }
-/******************JOBS COMMAND*/
 
-/*KILL COMMAND***************/
-KillCommand::KillCommand(const char *cmd_line, JobsList* jobs) : BuiltInCommand(cmd_line), c_jobs(jobs) {}
-void KillCommand::execute() 
+// reads /proc/<pid>/stat and /proc/<pid>/io of an already opened sample, false if the process is gone
+static bool _readTopCounters(int stat_fd, int io_fd, char* state, unsigned long long* cpu_ticks,
+                             long long* rss_pages, unsigned long long* read_bytes, unsigned long long* write_bytes)
 {
-  SmallShell &smash = SmallShell::getInstance();
-  c_jobs->removeFinishedJobs(); 
-  int signal = 0;
-  char* minus_signal = nullptr;
-  if(c_args[1] != nullptr)
+  char buf[4096];
+  ssize_t len = pread(stat_fd, buf, sizeof(buf) - 1, 0);
+  if (len <= 0)
+    return false;
+  buf[len] = '\0';
+  char* fields = strrchr(buf, ')'); // the command name may hold spaces and parentheses
+  if (fields == nullptr)
+    return false;
+  // fields from 3: state ppid pgrp session tty tpgid flags minflt cminflt majflt cmajflt
+  // utime stime cutime cstime priority nice threads itrealvalue starttime vsize rss
+  // cutime / cstime are left out: the sons a member reaped were members themselves, mostly
+  unsigned long long utime, stime;
+  if (sscanf(fields + 2, "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %*d %*d %*u %*u %lld",
+             state, &utime, &stime, rss_pages) != 4)
+    return false;
+  *cpu_ticks = utime + stime;
+
+  *read_bytes = 0;
+  *write_bytes = 0;
+  len = (io_fd == -1) ? -1 : pread(io_fd, buf, sizeof(buf) - 1, 0);
+  if (len > 0) // rchar / wchar: everything read and written, pipes and the page cache included
   {
-    minus_signal = c_args[1];
-    char* substr = (char*)malloc(strlen(minus_signal));
-    strcpy(substr, minus_signal+1);
-    signal = std::atoi(substr);
-    if ((!isANumber(substr)))
-    {
-      std::cerr << "smash error: kill: invalid arguments" << endl; 
-      free(substr);
-      return;
-    }
-    free(substr); 
-  }
-  
-  if (c_num_of_args != 3 || strcmp(c_args[0],"kill")!=0 || minus_signal[0] != '-' || signal < 1 || signal > 31 || (!isANumber(c_args[2])) ){
-    std::cerr << "smash error: kill: invalid arguments" << endl; 
-    return;
+    buf[len] = '\0';
+    const char* rchar = strstr(buf, "rchar: ");
+    const char* wchar = strstr(buf, "wchar: ");
+    if (rchar != nullptr)
+      *read_bytes = strtoull(rchar + 7, nullptr, 10);
+    if (wchar != nullptr)
+      *write_bytes = strtoull(wchar + 7, nullptr, 10);
   }
+  return true;
+}
 
-  int job_id = std::stoi(c_args[2]);
-  JobsList::JobEntry* job = c_jobs->getJobById(job_id);
-  if (job == nullptr){
-    std::cerr << "smash error: kill: job-id " << job_id << " does not exist" << endl; 
-    return;
+static std::string _humanBytes(double bytes)
+{
+  const char* units = "BKMGT";
+  int unit = 0;
+  while (bytes >= 1024 && unit < 4)
+  {
+    bytes /= 1024;
+    unit++;
   }
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(unit == 0 ? 0 : 1) << bytes << units[unit];
+  return out.str();
+}
 
-  int proccess_id = job->getProccessId();
-  if (kill(proccess_id,signal) == -1) {
-    perror("smash error: kill failed");
-    return; 
-  }
-  else {
-    std::cout << "signal number " << signal << " was sent to pid " << proccess_id << endl;
-    if(signal == 9) 
-    {
-      smash.getJobsList()->removeJobByPid(proccess_id);
-    } 
+// every process in the process group pgid, from /proc
+static std::vector<pid_t> _processGroupMembers(pid_t pgid)
+{
+  std::vector<pid_t> members;
+  std::vector<DirCache::DirEntry> procs;
+  int proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (proc_fd == -1)
+    return members;
+  _readDirEntries(proc_fd, procs);
+  close(proc_fd);
+  for (size_t i = 0; i < procs.size(); i++)
+  {
+    const std::string& name = procs[i].name;
+    if (std::isdigit(name[0]) && getpgid(atoi(name.c_str())) == pgid)
+      members.push_back(atoi(name.c_str()));
   }
+  return members;
 }
-/******************KILL COMMAND*/
 
-/*FOREGROUND COMMAND***************/
-ForegroundCommand::ForegroundCommand(const char *cmd_line, JobsList* jobs) : BuiltInCommand(cmd_line), c_jobs(jobs) {}
-void ForegroundCommand::execute()
+#define TOP_MEMBERS_EVERY 5 // refreshes between two walks of /proc for the members of a job's group
+
+void JobsCommand::closeSample(TopSample& sample)
 {
-  SmallShell& smash = SmallShell::getInstance();
-  c_jobs->removeFinishedJobs();
-  pid_t job_id_to_fg;
-  int status = 0;
-  JobsList::JobEntry* job_entry = nullptr;
-  if(c_num_of_args > 2 || (c_num_of_args == 2 && (!isANumber(c_args[1]))))
+  for (std::map<pid_t, TopMember>::iterator it = sample.members.begin(); it != sample.members.end(); it++)
   {
-    std::cerr << "smash error: fg: invalid arguments" << std::endl;
-    return;
+    close(it->second.stat_fd);
+    if (it->second.io_fd != -1)
+      close(it->second.io_fd);
   }
-  if(c_num_of_args==1) // case: fg max job id
+  sample.members.clear();
+}
+
+// one refresh: opens the files of new jobs and group members, closes the ones of finished jobs, and
+// computes the rates since the previous refresh summed over the job's group. a process has no rates
+// on its first refresh, and the group is walked again only every TOP_MEMBERS_EVERY refreshes
+void JobsCommand::sampleJobs(std::map<pid_t, TopSample>& samples, std::vector<TopRow>& rows)
+{
+  static const long ticks_per_sec = sysconf(_SC_CLK_TCK);
+  static const long page_size = sysconf(_SC_PAGESIZE);
+  c_jobs->removeFinishedJobs();
+  std::map<pid_t, TopSample> current;
+  double now = _monotonicSeconds();
+  for (size_t i = 0; i < c_jobs->jobs_list.size(); i++)
   {
-    if (c_jobs->isJobsListEmpty())
+    JobsList::JobEntry* job = c_jobs->jobs_list[i];
+    TopRow row;
+    row.job_id = job->getJobID();
+    row.pid = job->getProccessId();
+    row.state = '-';
+    row.cpu = 0;
+    row.rss = 0;
+    row.read_rate = 0;
+    row.write_rate = 0;
+    row.cmd = job->getCmd();
+    if (job->isBuiltIn()) // a thread of the smash, /proc has no per job numbers for it
     {
-      std::cerr << "smash error: fg: jobs list is empty" << std::endl;
-      return;
+      rows.push_back(row);
+      continue;
     }
-    job_id_to_fg = c_jobs->getMaxJobID();
-    job_entry = c_jobs->getJobById(job_id_to_fg);
-  }
-  if(c_num_of_args==2) // case fg given job id
-  {
-    int job_id = atoi(c_args[1]);
-    job_entry = c_jobs->getJobById(job_id);
-    if (job_entry==nullptr)
+    TopSample sample;
+    sample.refreshes = 0;
+    sample.time = now;
+    std::map<pid_t, TopSample>::iterator it = samples.find(row.pid);
+    if (it != samples.end())
     {
-      std::cerr << "smash error: fg: job-id " << job_id << " does not exist" << std::endl;
-      return;
+      sample = it->second;
+      samples.erase(it);
+    }
+    if (sample.refreshes-- <= 0) // the job's son leads its group
+    {
+      std::vector<pid_t> list = _processGroupMembers(row.pid);
+      std::set<pid_t> members(list.begin(), list.end());
+      members.insert(row.pid);
+      for (std::map<pid_t, TopMember>::iterator m = sample.members.begin(); m != sample.members.end();)
+      {
+        if (members.count(m->first))
+        {
+          m++;
+          continue;
+        }
+        close(m->second.stat_fd);
+        if (m->second.io_fd != -1)
+          close(m->second.io_fd);
+        sample.members.erase(m++);
+      }
+      for (std::set<pid_t>::iterator p = members.begin(); p != members.end(); p++)
+      {
+        if (sample.members.count(*p))
+          continue;
+        std::string proc = "/proc/" + std::to_string(*p);
+        TopMember member;
+        member.stat_fd = open((proc + "/stat").c_str(), O_RDONLY | O_CLOEXEC);
+        member.io_fd = open((proc + "/io").c_str(), O_RDONLY | O_CLOEXEC);
+        member.sampled = false;
+        if (member.stat_fd == -1)
+        {
+          if (member.io_fd != -1)
+            close(member.io_fd);
+          continue;
+        }
+        sample.members[*p] = member;
+      }
+      sample.refreshes = TOP_MEMBERS_EVERY - 1;
     }
-    job_id_to_fg = job_id;
-  }
-  // send signal (cont) and wait for procces to finish, remove from jobs and
-  // if stopped again by CTRLZ the singal handler will add it back to the jobs list
-  int pid_to_fg = job_entry->getProccessId();
-  int kill_result = kill(pid_to_fg,SIGCONT);
-  if (kill_result == -1)
-  {
-   perror("smash error: kill failed");
-   return;
-  }
+
+    double elapsed = now - sample.time;
+    bool leader_alive = false;
+    for (std::map<pid_t, TopMember>::iterator m = sample.members.begin(); m != sample.members.end();)
+    {
+      TopMember& member = m->second;
+      char state;
+      unsigned long long cpu_ticks, read_bytes, write_bytes;
+      long long rss_pages;
+      if (!_readTopCounters(member.stat_fd, member.io_fd, &state, &cpu_ticks, &rss_pages, &read_bytes, &write_bytes))
+      {
+        close(member.stat_fd);
+        if (member.io_fd != -1)
+          close(member.io_fd);
+        sample.members.erase(m++);
+        continue;
+      }
+      if (m->first == row.pid)
+      {
+        row.state = state;
+        leader_alive = true;
+      }
+      row.rss += rss_pages * page_size;
+      if (member.sampled && elapsed > 0)
+      {
+        row.cpu += 100.0 * (cpu_ticks - member.cpu_ticks) / ticks_per_sec / elapsed;
+        row.read_rate += (read_bytes - member.read_bytes) / elapsed;
+        row.write_rate += (write_bytes - member.write_bytes) / elapsed;
+      }
+      member.sampled = true;
+      member.cpu_ticks = cpu_ticks;
+      member.read_bytes = read_bytes;
+      member.write_bytes = write_bytes;
+      m++;
+    }
+    sample.time = now;
+    if (!leader_alive)
+    {
+      closeSample(sample);
+      continue;
+    }
+    current[row.pid] = sample;
+    rows.push_back(row);
+  }
+  for (std::map<pid_t, TopSample>::iterator it = samples.begin(); it != samples.end(); it++)
+    closeSample(it->second);
+  samples.swap(current);
+}
+
+// jobs --top: a table of the jobs sorted by cpu usage every interval seconds, count times
+// (0: until ctrl-C). on a terminal every refresh replaces the previous one
+void JobsCommand::top(double interval, long count)
+{
+  std::map<pid_t, TopSample> samples;
+  std::vector<TopRow> rows;
+  sampleJobs(samples, rows);
+  bool clear = isatty(c_out_fd);
+  for (long round = 0; (count == 0 || round < count) && !isCancelled(); round++)
+  {
+    double wake = _monotonicSeconds() + interval;
+    while (!isCancelled()) // short naps, so ctrl-C stops it right away
+    {
+      double left = wake - _monotonicSeconds();
+      if (left <= 0)
+        break;
+      usleep((useconds_t)(std::min(left, 0.05) * 1e6));
+    }
+    if (isCancelled())
+      break;
+    rows.clear();
+    sampleJobs(samples, rows);
+    std::sort(rows.begin(), rows.end(), [](const TopRow& a, const TopRow& b) {
+      return (a.cpu != b.cpu) ? a.cpu > b.cpu : a.job_id < b.job_id;
+    });
+
+    std::ostringstream out;
+    if (clear)
+      out << "\033[H\033[2J";
+    out << "jobs: " << rows.size() << ", every " << interval << "s" << endl;
+    out << std::left << std::setw(6) << "JOB" << std::right << std::setw(8) << "PID" << std::setw(3) << "S"
+        << std::setw(8) << "CPU%" << std::setw(9) << "RSS" << std::setw(9) << "READ/s" << std::setw(9) << "WRITE/s"
+        << "  COMMAND" << endl;
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+      const TopRow& row = rows[i];
+      std::string job = "[" + std::to_string(row.job_id) + "]";
+      out << std::left << std::setw(6) << job << std::right << std::setw(8) << row.pid << std::setw(3) << row.state;
+      if (row.state == '-') // a built-in thread
+        out << std::setw(8) << "-" << std::setw(9) << "-" << std::setw(9) << "-" << std::setw(9) << "-";
+      else
+        out << std::setw(8) << std::fixed << std::setprecision(1) << row.cpu << std::setw(9) << _humanBytes(row.rss)
+            << std::setw(9) << _humanBytes(row.read_rate) << std::setw(9) << _humanBytes(row.write_rate);
+      out << "  " << row.cmd << endl;
+    }
+    if (!writeOut(out.str()))
+      break;
+  }
+  for (std::map<pid_t, TopSample>::iterator it = samples.begin(); it != samples.end(); it++)
+    closeSample(it->second);
+}
+
+void JobsCommand::execute()
+{
+  if (c_num_of_args >= 2 && strcmp(c_args[1], "--top") == 0)
+  {
+    char* end = nullptr;
+    double interval = (c_num_of_args >= 3) ? strtod(c_args[2], &end) : 1;
+    long count = (c_num_of_args >= 4 && isANumber(c_args[3])) ? atol(c_args[3]) : 0;
+    if (c_num_of_args > 4 || (end != nullptr && (*end != '\0' || interval <= 0)) || (c_num_of_args == 4 && !isANumber(c_args[3])))
+    {
+      std::cerr << "smash error: jobs: invalid arguments" << std::endl;
+      return;
+    }
+    top(interval, count);
+    return;
+  }
+  std::ostringstream out;
+  if (c_num_of_args == 2 && strcmp(c_args[1], "-v") == 0)
+    c_jobs->printJobsVerbose(out);
+  else
+    c_jobs->printJobsList(out);
+  writeOut(out.str());
+}
+/******************JOBS COMMAND*/
+
+/*WAIT COMMAND***************/
+WaitCommand::WaitCommand(const char *cmd_line, JobsList* jobs) : BuiltInCommand(cmd_line), c_jobs(jobs) {}
+void WaitCommand::execute()
+{
+  SmallShell& smash = SmallShell::getInstance();
+  c_jobs->removeFinishedJobs();
+  bool any = c_num_of_args > 1 && strcmp(c_args[1], "-n") == 0;
+  std::set<int> targets;
+  for (int i = any ? 2 : 1; i < c_num_of_args; i++)
+  {
+    if (!isANumber(c_args[i]))
+    {
+      std::cerr << "smash error: wait: invalid arguments" << std::endl;
+      return;
+    }
+    int job_id = atoi(c_args[i]);
+    if (c_jobs->getJobById(job_id) == nullptr)
+    {
+      std::cerr << "smash error: wait: job-id " << job_id << " does not exist" << std::endl;
+      return;
+    }
+    targets.insert(job_id);
+  }
+  if (targets.empty())
+  {
+    for (size_t i = 0; i < c_jobs->jobs_list.size(); i++)
+      targets.insert(c_jobs->jobs_list[i]->getJobID());
+  }
+  if (targets.empty())
+    return;
+
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd == -1)
+  {
+    perror("smash error: epoll_create1 failed");
+    return;
+  }
+  // a closed fd leaves the epoll by itself, so the jobs reaped below need no epoll_ctl
+  bool polling = false; // a job without a pidfd is checked every 10ms instead
+  for (size_t i = 0; i < c_jobs->jobs_list.size(); i++)
+  {
+    JobsList::JobEntry* job = c_jobs->jobs_list[i];
+    if (targets.count(job->getJobID()) == 0)
+      continue;
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = job->getJobID();
+    int fd = job->isBuiltIn() ? job->getTask()->getDoneFd() : job->getPidFd();
+    if (fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+      polling = true;
+  }
+  int interrupts = smash.getInterrupts();
+  size_t waiting = targets.size();
+  while (!isCancelled() && smash.getInterrupts() == interrupts)
+  {
+    c_jobs->removeFinishedJobs();
+    waiting = 0;
+    for (size_t i = 0; i < c_jobs->jobs_list.size(); i++)
+      waiting += targets.count(c_jobs->jobs_list[i]->getJobID());
+    if (waiting == 0 || (any && waiting < targets.size()))
+      break;
+    struct epoll_event events[64];
+    if (epoll_wait(epoll_fd, events, 64, polling ? 10 : -1) == -1 && errno != EINTR)
+    {
+      perror("smash error: epoll_wait failed");
+      break;
+    }
+  }
+  close(epoll_fd);
+}
+/******************WAIT COMMAND*/
+
+/*KILL COMMAND***************/
+KillCommand::KillCommand(const char *cmd_line, JobsList* jobs) : BuiltInCommand(cmd_line), c_jobs(jobs) {}
+void KillCommand::execute() 
+{
+  SmallShell &smash = SmallShell::getInstance();
+  c_jobs->removeFinishedJobs(); 
+  int signal = 0;
+  char* minus_signal = nullptr;
+  if(c_args[1] != nullptr)
+  {
+    minus_signal = c_args[1];
+    char* substr = (char*)malloc(strlen(minus_signal));
+    strcpy(substr, minus_signal+1);
+    signal = std::atoi(substr);
+    if ((!isANumber(substr)))
+    {
+      std::cerr << "smash error: kill: invalid arguments" << endl; 
+      free(substr);
+      return;
+    }
+    free(substr); 
+  }
+  
+  if (c_num_of_args != 3 || strcmp(c_args[0],"kill")!=0 || minus_signal[0] != '-' || signal < 1 || signal > 31 || (!isANumber(c_args[2])) ){
+    std::cerr << "smash error: kill: invalid arguments" << endl; 
+    return;
+  }
+
+  int job_id = std::stoi(c_args[2]);
+  JobsList::JobEntry* job = c_jobs->getJobById(job_id);
+  if (job == nullptr){
+    std::cerr << "smash error: kill: job-id " << job_id << " does not exist" << endl; 
+    return;
+  }
+
+  int proccess_id = job->getProccessId();
+  if (job->isBuiltIn()) // a thread can only be asked to stop
+  {
+    if (signal != SIGKILL && signal != SIGTERM && signal != SIGINT && signal != SIGHUP && signal != SIGQUIT)
+    {
+      std::cerr << "smash error: kill: job-id " << job_id << " is a built-in and can only be terminated" << endl;
+      return;
+    }
+    job->getTask()->cancel();
+    std::cout << "signal number " << signal << " was sent to job " << job_id << " (thread)" << endl;
+    if (signal == SIGKILL) // the thread finishes on its own, the job is gone already
+    {
+      c_jobs->removeJobById(job_id);
+    }
+    return;
+  }
+  if (job->signal(signal) == -1) {
+    perror("smash error: kill failed");
+    return; 
+  }
+  else {
+    std::cout << "signal number " << signal << " was sent to pid " << proccess_id << endl;
+    if(signal == 9) 
+    {
+      smash.getJobsList()->removeKilledJob(proccess_id);
+    } 
+  }
+}
+/******************KILL COMMAND*/
+
+/*FOREGROUND COMMAND***************/
+ForegroundCommand::ForegroundCommand(const char *cmd_line, JobsList* jobs) : BuiltInCommand(cmd_line), c_jobs(jobs) {}
+void ForegroundCommand::execute()
+{
+  SmallShell& smash = SmallShell::getInstance();
+  c_jobs->removeFinishedJobs();
+  pid_t job_id_to_fg;
+  int status = 0;
+  JobsList::JobEntry* job_entry = nullptr;
+  if(c_num_of_args > 2 || (c_num_of_args == 2 && (!isANumber(c_args[1]))))
+  {
+    std::cerr << "smash error: fg: invalid arguments" << std::endl;
+    return;
+  }
+  if(c_num_of_args==1) // case: fg max job id
+  {
+    if (c_jobs->isJobsListEmpty())
+    {
+      std::cerr << "smash error: fg: jobs list is empty" << std::endl;
+      return;
+    }
+    job_id_to_fg = c_jobs->getMaxJobID();
+    job_entry = c_jobs->getJobById(job_id_to_fg);
+  }
+  if(c_num_of_args==2) // case fg given job id
+  {
+    int job_id = atoi(c_args[1]);
+    job_entry = c_jobs->getJobById(job_id);
+    if (job_entry==nullptr)
+    {
+      std::cerr << "smash error: fg: job-id " << job_id << " does not exist" << std::endl;
+      return;
+    }
+    job_id_to_fg = job_id;
+  }
+  if (job_entry->isBuiltIn()) // wait for the thread, ctrl-C cancels it
+  {
+    std::shared_ptr<BuiltInTask> task = job_entry->getTask();
+    std::cout<< job_entry->getCmd() << " : " << job_entry->getProccessId() << std::endl;
+    smash.setForegroundBuiltIn(task->getCommand());
+    task->waitFinished();
+    smash.setForegroundBuiltIn(nullptr);
+    c_jobs->removeFinishedJobs();
+    return;
+  }
+
+  // send signal (cont) and wait for procces to finish, remove from jobs and
+  // if stopped again by CTRLZ the singal handler will add it back to the jobs list
+  int pid_to_fg = job_entry->getProccessId();
+  int kill_result = job_entry->signal(SIGCONT);
+  if (kill_result == -1)
+  {
+   perror("smash error: kill failed");
+   return;
+  }
 
   smash.setIsFg(true);
   smash.setCurrentPid(pid_to_fg);
   Command* cmd = new ExternalCommand(job_entry->getCmd().c_str(),c_jobs);
   cmd->setPid(pid_to_fg);
+  cmd->setStartTime(job_entry->getStartTime());
   smash.setCurrentCommand(cmd);
 
   //print command info and update smash's current pid
   std::cout<< job_entry->getCmd() << " : " << job_entry->getProccessId() << std::endl;
 
-  waitpid(pid_to_fg,&status,WUNTRACED); 
+  struct rusage usage;
+  if (wait4(pid_to_fg, &status, WUNTRACED, &usage) == pid_to_fg && !WIFSTOPPED(status))
+  {
+    c_jobs->reapedProccess(pid_to_fg, status, usage);
+  }
   smash.setCurrentPid(-1);
   smash.setIsFg(false);
   
@@ -397,8 +1159,7 @@ void BackgroundCommand::execute()
   //first print the cmdline of the job to be resumed, then send signal (cont)
   job_entry->setIsStopped(false);
   std::cout<< job_entry->getCmd() << " : " << job_entry->getProccessId() << std::endl;
-  int pid_to_bg = job_entry->getProccessId();
-  int kill_result = kill(pid_to_bg,SIGCONT);
+  int kill_result = job_entry->signal(SIGCONT);
   if (kill_result == -1){
    perror("smash error: kill failed");
    return;
@@ -427,464 +1188,4519 @@ void QuitCommand::execute()
 }
 /******************QUIT COMMAND*/
 
-/*EXTERNAL COMMAND***************/
-ExternalCommand::ExternalCommand(const char *cmd_line, JobsList* jobs) : Command(cmd_line), c_jobs(jobs) {}  //changed
-void ExternalCommand::execute()
+/*TIME COMMAND***************/
+TimeCommand::TimeCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
+
+static double _timevalSeconds(const struct timeval& tv)
 {
-  if (c_args[0] == nullptr)
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// the cpu time is that of the smash thread running the command, of the pool threads for the work
+// the command handed them (not for background built-ins), and of the sons the command started,
+// from their wait4 (not of background jobs that happened to be reaped meanwhile)
+void TimeCommand::execute()
+{
+  if (c_num_of_args < 2)
   {
+    std::cerr << "smash error: time: invalid arguments" << std::endl;
     return;
   }
-  SmallShell& smash = SmallShell::getInstance();
-  bool is_bg = _isBackgroundComamnd(c_cmd_line.c_str());
-  const char* cmd_line = c_cmd_line.c_str();
-  int status = 0;
-  char* ex_cmd_line; 
-  bool is_timed = false;
-  int duration; 
-  
-  if (strcmp(c_args[0],"timeout") == 0)//case is timeout command
-  {
-    if(c_num_of_args < 3 || atoi(c_args[1])<=0 ) //handle wrong syntax of timeout
-    {
-      cerr << "smash error: timeout: invalid arguments" << endl;
-      return;
-    }
-    is_timed = true;
-    duration = atoi(c_args[1]); 
+  char* inner = new char[c_cmd_line.size() + 1];
+  strcpy(inner, _trim(c_cmd_line).substr(4).c_str());
+  _removeBackgroundSign(inner); // the command is timed in the foreground
+  std::string inner_line = _trim(inner);
+  delete[] inner;
 
-    int pos = c_cmd_line.find("timeout");
-    string fixed_cmd = c_cmd_line.substr(c_cmd_line.find_first_of(" ", pos));
-    fixed_cmd = fixed_cmd.substr(fixed_cmd.find_first_not_of(" "));
-    fixed_cmd = fixed_cmd.substr(fixed_cmd.find_first_of(" "));
-    fixed_cmd = fixed_cmd.substr(fixed_cmd.find_first_not_of(" "));
-
-    ex_cmd_line = new char[fixed_cmd.size()+1];
-    strcpy(ex_cmd_line, fixed_cmd.c_str());
-  }
-  else{
-    ex_cmd_line = new char[strlen(cmd_line)+1]; //create a non-const version of cmd_line //needs to be delete
-    strcpy(ex_cmd_line,cmd_line);
-  }
-  pid_t p2;
-  pid_t p = fork();
-  if(p == -1)
+  SmallShell& smash = SmallShell::getInstance();
+  bool was_timing = smash.isExecTiming();
+  int execs_before;
+  double latency_before = smash.getExecLatency(&execs_before);
+  JobsList* jobs = smash.getJobsList();
+  struct rusage* outer_sons = jobs->sons_usage; // a time inside a time
+  double outer_since = jobs->sons_since;
+  struct rusage self_before, pool_before = t_pool_usage, sons, self_after;
+  memset(&sons, 0, sizeof(sons));
+  getrusage(RUSAGE_THREAD, &self_before);
+  double start = _monotonicSeconds();
+  jobs->sons_usage = &sons;
+  jobs->sons_since = start;
+  smash.setExecTiming(true);
+
+  smash.executeCommand(inner_line.c_str());
+
+  double real = _monotonicSeconds() - start;
+  getrusage(RUSAGE_THREAD, &self_after);
+  jobs->sons_usage = outer_sons;
+  jobs->sons_since = outer_since;
+  if (outer_sons != nullptr)
   {
-    perror("smash error: fork failed");
-    delete[] ex_cmd_line;
-    return;
+    timeradd(&outer_sons->ru_utime, &sons.ru_utime, &outer_sons->ru_utime);
+    timeradd(&outer_sons->ru_stime, &sons.ru_stime, &outer_sons->ru_stime);
   }
-  else 
+  smash.setExecTiming(was_timing);
+  int execs;
+  double latency = smash.getExecLatency(&execs) - latency_before;
+  execs -= execs_before;
+
+  double user = _timevalSeconds(self_after.ru_utime) - _timevalSeconds(self_before.ru_utime) +
+                _timevalSeconds(t_pool_usage.ru_utime) - _timevalSeconds(pool_before.ru_utime) +
+                _timevalSeconds(sons.ru_utime);
+  double sys = _timevalSeconds(self_after.ru_stime) - _timevalSeconds(self_before.ru_stime) +
+               _timevalSeconds(t_pool_usage.ru_stime) - _timevalSeconds(pool_before.ru_stime) +
+               _timevalSeconds(sons.ru_stime);
+  std::cout.flush();
+  std::cerr << std::fixed << std::setprecision(6) << "real " << real << "s" << std::endl
+            << "user " << user << "s" << std::endl
+            << "sys  " << sys << "s" << std::endl;
+  if (execs > 0)
   {
-    if (p == 0) // son
-    {
-      setpgrp();
-      if(is_bg) //remove & from arguments
-      {
-        _removeBackgroundSign(ex_cmd_line);
-        char* bash_args[] = {(char *)"/bin/bash",(char *)"-c", ex_cmd_line, NULL};
-        c_pid = getpid();
-        execv("/bin/bash", bash_args); 
-      }
-      else
-      {
-        char* bash_args[] = {(char *)"/bin/bash",(char *)"-c", ex_cmd_line, NULL};
-        smash.setCurrentPid(getpid());
-        c_pid = getpid();
-        smash.setCurrentCommand(this);
-        execv("/bin/bash", bash_args); 
-      } 
-    }
-    if(p > 0) // parent
-    { 
-      delete[] ex_cmd_line;
-      if (is_timed)
-      {
-        pid_t smash_pid = getpid(); 
-        p2 = fork(); //another son for countdown
-        if (p2 == -1)
-        {
-          perror("smash error: fork failed");
-          return;
-        }
-        if (p2 == 0) //son whose aim is to count duration time untill sending alarm to smash
-        {
-          setpgrp();
-          sleep(duration);
-          if (kill(smash_pid, SIGALRM) == -1)
-          {
-            perror("smash error: kill failed"); 
-            return;
-          }
-          exit(0); 
-        }
-        if (p2 > 0){
-          TimedList& s_list = smash.getTimedList();
-          s_list.addTimedEntry(p2, p, c_cmd_line, duration);
-        }
-      }
-    
-      c_pid = p;
-      smash.setCurrentPid(p);
-      smash.setCurrentCommand(this);
-
-      TimedList& s_list = smash.getTimedList();
-      TimedList::TimedEntry& entry = s_list.getTimedEntryByPid(p2);
-      if (is_bg)
-      {
-        c_jobs->addJob(this);
-        smash.setCurrentPid(-1);
-        entry.setRunningTime(-1); // if is a background command put -1 in running time 
-      }
-      else  //foreground
-      {  
-        waitpid(p,&status,WUNTRACED); // also return if child 'p' was STOPPED
-        if(is_timed) // if is a timeout command calculate actual running time of procces
-        {
-          entry.setRunningTime(difftime(time(nullptr),entry.getStartTime()));
-        }
-      }
-    }
+    std::cerr << "exec " << latency << "s (" << execs << (execs == 1 ? " fork)" : " forks)") << std::endl;
   }
+  std::cerr.unsetf(std::ios_base::floatfield);
 }
-/******************EXTERNAL COMMAND*/
+/******************TIME COMMAND*/
 
-/*REDIRECTION COMMAND***************/
+/*BENCH COMMAND***************/
+BenchCommand::BenchCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
 
-RedirectionCommand::RedirectionCommand(const char* cmd_line, bool _append, size_t _pos): Command(cmd_line), append(_append), pos(_pos) {}
-void RedirectionCommand::execute()
+// nearest rank percentile of sorted latencies
+static double _percentile(const std::vector<double>& sorted, double p)
 {
-  size_t x = (append == true) ? 2 : 1;
-  std::string cmd_string = c_cmd_line.substr(0,pos);
-  std::string output_file_string = _trim(c_cmd_line.substr(pos+x ,c_cmd_line.size() - cmd_string.size() - x));
+  size_t rank = (size_t)ceil(p / 100 * sorted.size());
+  return sorted[rank == 0 ? 0 : rank - 1];
+}
 
-  if(dup2(1,5)==-1)
+void BenchCommand::execute()
+{
+  // options come first, the rest of the line (pipes and redirections included) is the command
+  std::string rest = _trim(c_cmd_line).substr(5);
+  long runs = 10, warmup = 1;
+  bool quiet = false;
+  bool valid = true;
+  while (valid)
   {
-    perror("smash error: dup2 failed");
-    return;
+    rest = _trim(rest);
+    std::string word = rest.substr(0, rest.find_first_of(WHITESPACE));
+    if (word == "-q")
+    {
+      quiet = true;
+    }
+    else if (word == "-n" || word == "-w")
+    {
+      rest = _trim(rest.substr(word.size()));
+      std::string number = rest.substr(0, rest.find_first_of(WHITESPACE));
+      valid = !number.empty() && isANumber(number.c_str());
+      if (valid)
+        (word == "-n" ? runs : warmup) = atol(number.c_str());
+      word = number;
+    }
+    else
+    {
+      break;
+    }
+    rest = rest.substr(word.size());
   }
-  if (close(1) == -1)
+  char* inner = new char[rest.size() + 1];
+  strcpy(inner, rest.c_str());
+  if (rest.size() > 0)
+    _removeBackgroundSign(inner); // the runs are timed in the foreground
+  std::string inner_line = _trim(inner);
+  delete[] inner;
+  if (!valid || runs < 1 || warmup < 0 || inner_line.empty())
   {
-    perror("smash error: close failed");
+    std::cerr << "smash error: bench: invalid arguments" << std::endl;
     return;
   }
 
-  int fd;
-  if (append)
+  SmallShell& smash = SmallShell::getInstance();
+  int out_fd = STDOUT_FILENO;
+  if (quiet) // only the runs' output goes away, background jobs keep writing to the smash's stdout
   {
-    fd =open(output_file_string.c_str(),O_CREAT | O_RDWR | O_APPEND, 0655); //-rw-r-xr-x
-    if(fd == -1)
+    out_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (out_fd == -1)
     {
       perror("smash error: open failed");
-      dup2(5,1);
+      return;
     }
   }
-  else
+
+  // ctrl-C kills a running son or cancels a running built-in, either way the bench stops too
+  int interrupts = smash.getInterrupts();
+  std::vector<double> latencies;
+  latencies.reserve(runs);
+  double total = 0;
+  for (long i = 0; i < warmup + runs && !isCancelled() && smash.getInterrupts() == interrupts; i++)
+  {
+    double start = _monotonicSeconds();
+    smash.executeCommand(inner_line.c_str(), out_fd);
+    double took = _monotonicSeconds() - start;
+    smash.setForegroundBuiltIn(this);
+    if (i >= warmup)
+    {
+      latencies.push_back(took);
+      total += took;
+    }
+  }
+
+  if (out_fd != STDOUT_FILENO)
+    close(out_fd);
+  if (latencies.empty())
+    return;
+  std::sort(latencies.begin(), latencies.end());
+  std::ostringstream out;
+  out << "bench: " << latencies.size() << " runs (" << warmup << " warmup) of " << inner_line << endl
+      << std::fixed << std::setprecision(6)
+      << "min " << latencies[0] << "s p50 " << _percentile(latencies, 50) << "s p90 " << _percentile(latencies, 90)
+      << "s p99 " << _percentile(latencies, 99) << "s max " << latencies.back() << "s" << endl
+      << "mean " << total / latencies.size() << "s, " << std::setprecision(1) << latencies.size() / total << " runs/s" << endl;
+  writeOut(out.str());
+}
+/******************BENCH COMMAND*/
+
+/*SCHED CONTROL COMMAND***************/
+static const char* const SCHED_POLICY_NAMES[] = {"other", "fifo", "rr", "batch", "", "idle"}; // by SCHED_* value
+
+// "0-3,8" -> cpus, false if it is not a valid cpu list
+static bool _parseCpuList(const std::string& list, cpu_set_t* cpus)
+{
+  CPU_ZERO(cpus);
+  std::istringstream ranges(list);
+  std::string range;
+  bool any = false;
+  while (std::getline(ranges, range, ','))
+  {
+    char* end = nullptr;
+    long first = strtol(range.c_str(), &end, 10);
+    long last = first;
+    if (end == range.c_str())
+      return false;
+    if (*end == '-')
+    {
+      const char* second = end + 1;
+      last = strtol(second, &end, 10);
+      if (end == second)
+        return false;
+    }
+    if (*end != '\0' || first < 0 || last < first || last >= CPU_SETSIZE)
+      return false;
+    for (long cpu = first; cpu <= last; cpu++)
+    {
+      CPU_SET(cpu, cpus);
+    }
+    any = true;
+  }
+  return any;
+}
+
+static std::string _formatCpuList(const cpu_set_t& cpus)
+{
+  std::ostringstream out;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+  {
+    if (!CPU_ISSET(cpu, &cpus))
+      continue;
+    int last = cpu;
+    while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &cpus))
+      last++;
+    out << (out.tellp() > 0 ? "," : "") << cpu;
+    if (last > cpu)
+      out << "-" << last;
+    cpu = last;
+  }
+  return out.str();
+}
+
+// affinity, nice and policy of a running son, for jobs -v
+static std::string _formatSched(pid_t pid)
+{
+  std::ostringstream out;
+  cpu_set_t cpus;
+  if (sched_getaffinity(pid, sizeof(cpus), &cpus) == 0)
+    out << " cpus " << _formatCpuList(cpus);
+  errno = 0;
+  int nice = getpriority(PRIO_PROCESS, pid);
+  if (errno == 0)
+    out << " nice " << nice;
+  int policy = sched_getscheduler(pid) & ~SCHED_RESET_ON_FORK;
+  if (policy >= 0 && policy <= SCHED_IDLE && SCHED_POLICY_NAMES[policy][0] != '\0')
+  {
+    out << " sched " << SCHED_POLICY_NAMES[policy];
+    struct sched_param param;
+    if ((policy == SCHED_FIFO || policy == SCHED_RR) && sched_getparam(pid, &param) == 0)
+      out << " " << param.sched_priority;
+  }
+  return out.str();
+}
+
+// the first word of rest, which is left with what follows it
+static std::string _takeWord(std::string& rest)
+{
+  rest = _trim(rest);
+  std::string word = rest.substr(0, rest.find_first_of(WHITESPACE));
+  rest = rest.substr(word.size());
+  return word;
+}
+
+SchedSettings::SchedSettings() : has_cpus(false), has_nice(false), nice(0), policy(-1), priority(0)
+{
+  CPU_ZERO(&cpus);
+}
+
+bool SchedSettings::isSet() const
+{
+  return has_cpus || has_nice || policy != -1;
+}
+
+void SchedSettings::merge(const SchedSettings& other)
+{
+  if (other.has_cpus)
+  {
+    has_cpus = true;
+    cpus = other.cpus;
+  }
+  if (other.has_nice)
+  {
+    has_nice = true;
+    nice = other.nice;
+  }
+  if (other.policy != -1)
+  {
+    policy = other.policy;
+    priority = other.priority;
+  }
+}
+
+// the policy goes first: nice has no effect on SCHED_FIFO / RR threads but is kept for a later change
+bool SchedSettings::apply(pid_t tid) const
+{
+  if (policy != -1)
+  {
+    struct sched_param param;
+    param.sched_priority = priority;
+    if (sched_setscheduler(tid, policy, &param) == -1)
+    {
+      perror("smash error: sched_setscheduler failed");
+      return false;
+    }
+  }
+  if (has_nice && setpriority(PRIO_PROCESS, tid, nice) == -1) // per thread on linux
+  {
+    perror("smash error: setpriority failed");
+    return false;
+  }
+  if (has_cpus && sched_setaffinity(tid, sizeof(cpus), &cpus) == -1)
+  {
+    perror("smash error: sched_setaffinity failed");
+    return false;
+  }
+  return true;
+}
+
+// every thread of every process in the process group pgid, from /proc
+static std::vector<pid_t> _processGroupThreads(pid_t pgid)
+{
+  std::vector<pid_t> threads;
+  std::vector<pid_t> members = _processGroupMembers(pgid);
+  for (size_t i = 0; i < members.size(); i++)
+  {
+    std::vector<DirCache::DirEntry> tasks;
+    int task_fd = open(("/proc/" + std::to_string(members[i]) + "/task").c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (task_fd == -1)
+      continue; // exited meanwhile
+    _readDirEntries(task_fd, tasks);
+    close(task_fd);
+    for (size_t j = 0; j < tasks.size(); j++)
+    {
+      threads.push_back(atoi(tasks[j].name.c_str()));
+    }
+  }
+  return threads;
+}
+
+SchedControlCommand::SchedControlCommand(const char *cmd_line, JobsList* jobs) : BuiltInCommand(cmd_line), c_jobs(jobs) {}
+
+// the setting of this built-in from the start of rest, which is left with what follows it
+bool SchedControlCommand::parseSetting(std::string& rest, SchedSettings& settings)
+{
+  std::string name = c_args[0];
+  if (name == "affinity")
+  {
+    settings.has_cpus = _parseCpuList(_takeWord(rest), &settings.cpus);
+    return settings.has_cpus;
+  }
+  if (name == "nice")
+  {
+    std::string saved = rest;
+    std::string word = _takeWord(rest);
+    settings.has_nice = true;
+    settings.nice = 10; // like nice(1)
+    if (word != "-n")
+    {
+      rest = saved;
+      return true;
+    }
+    word = _takeWord(rest);
+    settings.nice = atoi(word.c_str());
+    return !word.empty() && word != "-" && isANumber(word.c_str()) && settings.nice >= -20 && settings.nice <= 19;
+  }
+  std::string policy = _takeWord(rest);
+  for (int i = 0; i <= SCHED_IDLE; i++)
+  {
+    if (policy == SCHED_POLICY_NAMES[i] && !policy.empty())
+      settings.policy = i;
+  }
+  if (settings.policy == SCHED_FIFO || settings.policy == SCHED_RR)
+  {
+    std::string priority = _takeWord(rest);
+    settings.priority = atoi(priority.c_str());
+    return !priority.empty() && isANumber(priority.c_str()) && settings.priority >= sched_get_priority_min(settings.policy) &&
+           settings.priority <= sched_get_priority_max(settings.policy);
+  }
+  return settings.policy != -1;
+}
+
+void SchedControlCommand::execute()
+{
+  std::string name = c_args[0];
+  std::string rest = _trim(c_cmd_line).substr(name.size());
+  std::string saved = rest;
+  int job_id = -1;
+  if (_takeWord(rest) == "-j")
+  {
+    std::string number = _takeWord(rest);
+    job_id = (!number.empty() && isANumber(number.c_str())) ? atoi(number.c_str()) : 0;
+  }
+  else
+  {
+    rest = saved;
+  }
+  SchedSettings settings;
+  bool valid = job_id != 0 && parseSetting(rest, settings);
+  if (job_id != -1) // nothing may follow the setting, but a '&'
+  {
+    char* tail = new char[rest.size() + 1];
+    strcpy(tail, rest.c_str());
+    if (rest.size() > 0)
+      _removeBackgroundSign(tail);
+    valid = valid && _trim(tail).empty();
+    delete[] tail;
+  }
+  else
+  {
+    valid = valid && !_trim(rest).empty();
+  }
+  if (!valid)
+  {
+    std::cerr << "smash error: " << name << ": invalid arguments" << std::endl;
+    return;
+  }
+
+  SmallShell& smash = SmallShell::getInstance();
+  if (job_id == -1) // the command line's sons apply it before exec, and their sons inherit it
+  {
+    SchedSettings saved_sched = smash.getLaunchSched();
+    SchedSettings launch_sched = saved_sched;
+    launch_sched.merge(settings);
+    smash.setLaunchSched(launch_sched);
+    smash.executeCommand(_trim(rest).c_str());
+    smash.setLaunchSched(saved_sched);
+    return;
+  }
+
+  c_jobs->removeFinishedJobs();
+  JobsList::JobEntry* job = c_jobs->getJobById(job_id);
+  if (job == nullptr)
+  {
+    std::cerr << "smash error: " << name << ": job-id " << job_id << " does not exist" << std::endl;
+    return;
+  }
+  if (job->isBuiltIn())
+  {
+    std::cerr << "smash error: " << name << ": job-id " << job_id << " is a built-in" << std::endl;
+    return;
+  }
+  std::vector<pid_t> threads = _processGroupThreads(job->getProccessId()); // the job's son leads its group
+  for (size_t i = 0; i < threads.size(); i++)
+  {
+    if (!settings.apply(threads[i]))
+      return;
+  }
+}
+/******************SCHED CONTROL COMMAND*/
+
+/*STATS COMMAND***************/
+LatencyHistogram::LatencyHistogram()
+{
+  reset();
+}
+
+void LatencyHistogram::reset()
+{
+  memset(counts, 0, sizeof(counts));
+  count = 0;
+  sum = 0;
+  min = 0;
+  max = 0;
+}
+
+// values below 8 have a bucket each, above that a power of two is split into 8 buckets
+int LatencyHistogram::bucketOf(unsigned long long ns)
+{
+  if (ns < SUB_BUCKETS)
+    return ns;
+  int exponent = 63 - __builtin_clzll(ns);
+  int sub = (ns >> (exponent - 3)) & (SUB_BUCKETS - 1);
+  return std::min((exponent - 2) * SUB_BUCKETS + sub, BUCKETS - 1);
+}
+
+unsigned long long LatencyHistogram::bucketTop(int bucket)
+{
+  if (bucket < SUB_BUCKETS)
+    return bucket;
+  int exponent = bucket / SUB_BUCKETS + 2;
+  unsigned long long low = (unsigned long long)(SUB_BUCKETS + bucket % SUB_BUCKETS) << (exponent - 3);
+  return low + (1ULL << (exponent - 3)) - 1;
+}
+
+void LatencyHistogram::record(unsigned long long ns)
+{
+  counts[bucketOf(ns)]++;
+  if (count == 0 || ns < min)
+    min = ns;
+  if (ns > max)
+    max = ns;
+  count++;
+  sum += ns;
+}
+
+unsigned long long LatencyHistogram::getCount() const
+{
+  return count;
+}
+
+unsigned long long LatencyHistogram::getMin() const
+{
+  return min;
+}
+
+unsigned long long LatencyHistogram::getMax() const
+{
+  return max;
+}
+
+double LatencyHistogram::getMean() const
+{
+  return count == 0 ? 0 : (double)sum / count;
+}
+
+// the highest value of the bucket holding the p-th percentile (never more than the max seen)
+unsigned long long LatencyHistogram::percentile(double p) const
+{
+  if (count == 0)
+    return 0;
+  unsigned long long rank = (unsigned long long)ceil(p / 100 * count);
+  if (rank == 0)
+    rank = 1;
+  unsigned long long seen = 0;
+  for (int i = 0; i < BUCKETS; i++)
+  {
+    seen += counts[i];
+    if (seen >= rank)
+      return std::min(bucketTop(i), max);
+  }
+  return max;
+}
+
+void LatencyHistogram::dump(std::ostream& out) const
+{
+  out << "{\"count\": " << count << ", \"sum_ns\": " << sum << ", \"min_ns\": " << min << ", \"max_ns\": " << max
+      << ", \"p50_ns\": " << percentile(50) << ", \"p90_ns\": " << percentile(90) << ", \"p99_ns\": " << percentile(99)
+      << ", \"buckets\": [";
+  bool first = true;
+  for (int i = 0; i < BUCKETS; i++)
+  {
+    if (counts[i] == 0)
+      continue;
+    out << (first ? "" : ", ") << "[" << bucketTop(i) << ", " << counts[i] << "]";
+    first = false;
+  }
+  out << "]}";
+}
+
+static const char* STAT_KIND_NAMES[STAT_KINDS] = {"built-in", "external", "pipe", "redirect"};
+static const char* STAT_PHASE_NAMES[STAT_PHASES] = {"parse", "fork", "run", "reap", "total"};
+
+StatsCommand::StatsCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
+
+bool StatsCommand::canRunInPipe() const
+{
+  return true;
+}
+
+void StatsCommand::execute()
+{
+  SmallShell& smash = SmallShell::getInstance();
+  if (c_num_of_args == 2 && strcmp(c_args[1], "--reset") == 0)
+  {
+    for (int kind = 0; kind < STAT_KINDS; kind++)
+      for (int phase = 0; phase < STAT_PHASES; phase++)
+        smash.getStat(kind, phase).reset();
+    return;
+  }
+  if (c_num_of_args == 3 && strcmp(c_args[1], "--dump") == 0)
+  {
+    std::ofstream out(c_args[2]);
+    if (!out)
+    {
+      perror("smash error: open failed");
+      return;
+    }
+    out << "{" << endl;
+    for (int kind = 0; kind < STAT_KINDS; kind++)
+    {
+      out << "  \"" << STAT_KIND_NAMES[kind] << "\": {" << endl;
+      for (int phase = 0; phase < STAT_PHASES; phase++)
+      {
+        out << "    \"" << STAT_PHASE_NAMES[phase] << "\": ";
+        smash.getStat(kind, phase).dump(out);
+        out << (phase + 1 < STAT_PHASES ? "," : "") << endl;
+      }
+      out << "  }" << (kind + 1 < STAT_KINDS ? "," : "") << endl;
+    }
+    out << "}" << endl;
+    return;
+  }
+  if (c_num_of_args != 1)
+  {
+    std::cerr << "smash error: stats: invalid arguments" << std::endl;
+    return;
+  }
+
+  // microseconds, the kinds and phases nothing was recorded for are left out
+  std::ostringstream out;
+  out << std::left << std::setw(10) << "kind" << std::setw(7) << "phase" << std::right << std::setw(9) << "count"
+      << std::setw(11) << "p50 us" << std::setw(11) << "p90 us" << std::setw(11) << "p99 us" << std::setw(11) << "max us"
+      << std::setw(11) << "mean us" << endl;
+  out << std::fixed << std::setprecision(1);
+  for (int kind = 0; kind < STAT_KINDS; kind++)
+  {
+    for (int phase = 0; phase < STAT_PHASES; phase++)
+    {
+      const LatencyHistogram& stat = smash.getStat(kind, phase);
+      if (stat.getCount() == 0)
+        continue;
+      out << std::left << std::setw(10) << STAT_KIND_NAMES[kind] << std::setw(7) << STAT_PHASE_NAMES[phase] << std::right
+          << std::setw(9) << stat.getCount() << std::setw(11) << stat.percentile(50) / 1e3 << std::setw(11) << stat.percentile(90) / 1e3
+          << std::setw(11) << stat.percentile(99) / 1e3 << std::setw(11) << stat.getMax() / 1e3 << std::setw(11) << stat.getMean() / 1e3 << endl;
+    }
+  }
+  writeOut(out.str());
+}
+/******************STATS COMMAND*/
+
+/*TRACE COMMAND***************/
+Tracer::Tracer() : ring(nullptr), enabled(false), start_ns(0) {}
+
+Tracer::~Tracer()
+{
+  if (ring != nullptr)
+    munmap(ring, sizeof(Ring));
+}
+
+unsigned long long Tracer::now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+bool Tracer::isOn() const
+{
+  return enabled;
+}
+
+bool Tracer::start(const std::string& file_path)
+{
+  if (ring == nullptr)
+  {
+    void* mem = mmap(nullptr, sizeof(Ring), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+      perror("smash error: mmap failed");
+      return false;
+    }
+    ring = static_cast<Ring*>(mem);
+  }
+  for (unsigned long long i = 0; i < CAPACITY; i++) // events of an earlier trace must not look valid
+  {
+    ring->events[i].seq.store(0, std::memory_order_relaxed);
+  }
+  ring->head.store(0);
+  path = file_path;
+  start_ns = now();
+  enabled = true;
+  return true;
+}
+
+// async signal safe: no locks, no allocation
+void Tracer::record(char ph, const char* name, unsigned long long ts, unsigned long long dur, pid_t pid,
+                    const char* arg_name, long long arg, const char* text)
+{
+  unsigned long long index = ring->head.fetch_add(1, std::memory_order_relaxed);
+  Event& event = ring->events[index % CAPACITY];
+  event.seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release); // a reader sees seq change before any of data
+  EventData& data = event.data;
+  data.ts = ts;
+  data.dur = dur;
+  data.pid = (pid != 0) ? pid : getpid();
+  data.tid = (pid != 0) ? pid : syscall(SYS_gettid);
+  data.ph = ph;
+  data.name = name;
+  data.arg_name = arg_name;
+  data.arg = arg;
+  data.text[0] = '\0';
+  if (text != nullptr)
+  {
+    strncpy(data.text, text, sizeof(data.text) - 1);
+    data.text[sizeof(data.text) - 1] = '\0';
+  }
+  event.seq.store(index + 1, std::memory_order_release);
+}
+
+void Tracer::instant(const char* name, const char* arg_name, long long arg, const char* text, pid_t pid)
+{
+  if (enabled)
+    record('i', name, now(), 0, pid, arg_name, arg, text);
+}
+
+void Tracer::complete(const char* name, unsigned long long begin_ns, unsigned long long end_ns, const char* text, pid_t pid)
+{
+  if (enabled)
+    record('X', name, begin_ns, end_ns > begin_ns ? end_ns - begin_ns : 0, pid, nullptr, 0, text);
+}
+
+static std::string _jsonEscape(const char* str)
+{
+  std::string escaped;
+  for (; *str != '\0'; str++)
+  {
+    unsigned char c = *str;
+    if (c == '"' || c == '\\')
+      escaped += '\\';
+    if (c < 0x20)
+    {
+      char code[8];
+      snprintf(code, sizeof(code), "\\u%04x", c);
+      escaped += code;
+      continue;
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+// chrome trace event format (also read by perfetto): one track per process, the sons are named
+// after their command lines
+bool Tracer::stop()
+{
+  enabled = false;
+  std::ofstream out(path.c_str());
+  if (!out)
+  {
+    perror("smash error: open failed");
+    return false;
+  }
+  unsigned long long head = ring->head.load();
+  unsigned long long first = (head > CAPACITY) ? head - CAPACITY : 0;
+  std::map<int, std::string> process_names;
+  process_names[getpid()] = "smash";
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << endl;
+  out << std::fixed << std::setprecision(3);
+  bool any = false;
+  for (unsigned long long i = first; i < head; i++)
+  {
+    const Event& event = ring->events[i % CAPACITY];
+    if (event.seq.load(std::memory_order_acquire) != i + 1) // overwritten or unfinished
+      continue;
+    EventData data = event.data;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (event.seq.load(std::memory_order_relaxed) != i + 1 || data.ts < start_ns) // overwritten while copied
+      continue;
+    data.text[sizeof(data.text) - 1] = '\0';
+    out << (any ? ",\n" : "") << "{\"name\": \"" << _jsonEscape(data.name) << "\", \"ph\": \"" << data.ph
+        << "\", \"ts\": " << (data.ts - start_ns) / 1e3 << ", \"pid\": " << data.pid << ", \"tid\": " << data.tid;
+    if (data.ph == 'X')
+      out << ", \"dur\": " << data.dur / 1e3;
+    else
+      out << ", \"s\": \"t\"";
+    out << ", \"args\": {";
+    if (data.arg_name != nullptr)
+      out << "\"" << data.arg_name << "\": " << data.arg << (data.text[0] != '\0' ? ", " : "");
+    if (data.text[0] != '\0')
+      out << "\"text\": \"" << _jsonEscape(data.text) << "\"";
+    out << "}}";
+    any = true;
+    if (strcmp(data.name, "process") == 0)
+      process_names[data.pid] = data.text;
+  }
+  for (std::map<int, std::string>::iterator it = process_names.begin(); it != process_names.end(); it++)
+  {
+    out << (any ? ",\n" : "") << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << it->first
+        << ", \"args\": {\"name\": \"" << _jsonEscape(it->second.c_str()) << "\"}}";
+    any = true;
+  }
+  out << endl << "]}" << endl;
+  if (head > CAPACITY)
+  {
+    std::cerr << "smash: trace: " << head - CAPACITY << " oldest events were overwritten" << std::endl;
+  }
+  return true;
+}
+
+TraceCommand::TraceCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
+
+void TraceCommand::execute()
+{
+  Tracer& tracer = SmallShell::getInstance().getTracer();
+  if (c_num_of_args == 3 && strcmp(c_args[1], "on") == 0)
+  {
+    if (tracer.isOn())
+    {
+      std::cerr << "smash error: trace: already on" << std::endl;
+      return;
+    }
+    tracer.start(c_args[2]);
+    return;
+  }
+  if (c_num_of_args == 2 && strcmp(c_args[1], "off") == 0)
+  {
+    if (!tracer.isOn())
+    {
+      std::cerr << "smash error: trace: not on" << std::endl;
+      return;
+    }
+    tracer.stop();
+    return;
+  }
+  std::cerr << "smash error: trace: invalid arguments" << std::endl;
+}
+/******************TRACE COMMAND*/
+
+/*THROTTLE COMMAND***************/
+Throttler::Throttler() : worker(nullptr), owner(-1), mode(OFF), percent(0), active(false), restored(true), quit(false) {}
+
+Throttler::~Throttler()
+{
+  if (worker == nullptr || owner != getpid()) // a forked smash has no thread to join
+    return;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    quit = true;
+  }
+  cond.notify_all();
+  worker->join();
+  delete worker;
+}
+
+void Throttler::setMode(Mode _mode, int _percent)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  mode = _mode;
+  percent = _percent;
+  if (mode != OFF && worker == nullptr)
+  {
+    // like the pool's workers, with every signal blocked so they all reach the main thread
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    worker = new std::thread(&Throttler::run, this);
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    owner = getpid();
+  }
+}
+
+Throttler::Mode Throttler::getMode()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return mode;
+}
+
+int Throttler::getPercent()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return percent;
+}
+
+// the worker may still signal after the jobs list closed a reaped job's pidfd, so it gets its own copies
+bool Throttler::begin(const std::vector<Group>& _groups)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (mode == OFF || active || _groups.empty() || owner != getpid())
+    return false;
+  groups = _groups;
+  for (size_t i = 0; i < groups.size(); i++)
+  {
+    if (groups[i].pidfd != -1)
+      groups[i].pidfd = fcntl(groups[i].pidfd, F_DUPFD_CLOEXEC, 3);
+  }
+  active = true;
+  cond.notify_all();
+  return true;
+}
+
+void Throttler::end()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  active = false;
+  cond.notify_all();
+  cond.wait(guard, [this]() { return restored; });
+  for (size_t i = 0; i < groups.size(); i++)
+  {
+    if (groups[i].pidfd != -1)
+      close(groups[i].pidfd);
+  }
+  groups.clear();
+}
+
+// the group id can not be reused while its leader is not reaped - the pidfd tells
+static bool _groupAlive(const Throttler::Group& group)
+{
+  return _sendSignal(group.pidfd, group.pgid, 0) == 0;
+}
+
+static void _signalGroups(const std::vector<Throttler::Group>& groups, int sig)
+{
+  for (size_t i = 0; i < groups.size(); i++)
+  {
+    if (_groupAlive(groups[i]))
+      kill(-groups[i].pgid, sig);
+  }
+}
+
+void Throttler::run()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (true)
+  {
+    cond.wait(guard, [this]() { return quit || active; });
+    if (quit)
+      return;
+    if (cond.wait_for(guard, std::chrono::milliseconds(GRACE_MS), [this]() { return quit || !active; }))
+      continue;
+    std::vector<Group> targets = groups;
+    restored = false;
+    if (mode == NICE)
+    {
+      // every thread's own nice is kept, so what nice -j set comes back afterwards
+      std::vector<std::pair<pid_t, int> > saved;
+      guard.unlock();
+      for (size_t i = 0; i < targets.size(); i++)
+      {
+        if (!_groupAlive(targets[i]))
+          continue;
+        std::vector<pid_t> threads = _processGroupThreads(targets[i].pgid);
+        for (size_t j = 0; j < threads.size(); j++)
+        {
+          errno = 0;
+          int nice = getpriority(PRIO_PROCESS, threads[j]);
+          if (errno == 0 && setpriority(PRIO_PROCESS, threads[j], 19) == 0)
+            saved.push_back(std::make_pair(threads[j], nice));
+        }
+      }
+      guard.lock();
+      cond.wait(guard, [this]() { return quit || !active; });
+      guard.unlock();
+      for (size_t i = 0; i < saved.size(); i++)
+      {
+        setpriority(PRIO_PROCESS, saved[i].first, saved[i].second); // lowering it back may be refused
+      }
+      guard.lock();
+    }
+    else
+    {
+      std::chrono::milliseconds running(PERIOD_MS * percent / 100);
+      std::chrono::milliseconds stopped(PERIOD_MS - PERIOD_MS * percent / 100);
+      while (!quit && active)
+      {
+        _signalGroups(targets, SIGSTOP);
+        cond.wait_for(guard, stopped, [this]() { return quit || !active; });
+        _signalGroups(targets, SIGCONT);
+        if (quit || !active || running.count() == 0)
+          continue;
+        cond.wait_for(guard, running, [this]() { return quit || !active; });
+      }
+    }
+    restored = true;
+    cond.notify_all();
+  }
+}
+
+ThrottleCommand::ThrottleCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
+
+void ThrottleCommand::execute()
+{
+  Throttler& throttler = SmallShell::getInstance().getThrottler();
+  if (c_num_of_args == 1)
+  {
+    Throttler::Mode mode = throttler.getMode();
+    cout << "throttle: ";
+    if (mode == Throttler::OFF)
+      cout << "off" << endl;
+    else if (mode == Throttler::NICE)
+      cout << "nice" << endl;
+    else
+      cout << "stop, background jobs run " << throttler.getPercent() << "%" << endl;
+    return;
+  }
+  if (c_num_of_args == 2 && strcmp(c_args[1], "off") == 0)
+  {
+    throttler.setMode(Throttler::OFF);
+    return;
+  }
+  if (c_num_of_args >= 2 && c_num_of_args <= 4 && strcmp(c_args[1], "on") == 0)
+  {
+    if (c_num_of_args == 2 || (c_num_of_args == 3 && strcmp(c_args[2], "stop") == 0))
+    {
+      throttler.setMode(Throttler::STOP, 10);
+      return;
+    }
+    if (c_num_of_args == 3 && strcmp(c_args[2], "nice") == 0)
+    {
+      throttler.setMode(Throttler::NICE);
+      return;
+    }
+    if (c_num_of_args == 4 && strcmp(c_args[2], "stop") == 0 && c_args[3][0] != '-' && c_args[3][0] != '\0' &&
+        isANumber(c_args[3]) && atoi(c_args[3]) < 100)
+    {
+      throttler.setMode(Throttler::STOP, atoi(c_args[3]));
+      return;
+    }
+  }
+  std::cerr << "smash error: throttle: invalid arguments" << std::endl;
+}
+/******************THROTTLE COMMAND*/
+
+/*PERF COUNTERS***************/
+static const char* const PERF_COUNTER_NAMES[PerfCounters::COUNTERS] = {
+  "cycles", "instructions", "cache-misses", "branch-misses", "task-clock", "ctxsw", "faults"
+};
+
+static int _openPerfCounter(pid_t pid, unsigned type, unsigned long long config)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.inherit = 1;
+  attr.exclude_hv = 1;
+  if (pid != 0) // a son between fork and exec: count from the exec on
+  {
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+  }
+  int fd = syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+  if (fd == -1 && (errno == EACCES || errno == EPERM)) // perf_event_paranoid: user space only
+  {
+    attr.exclude_kernel = 1;
+    fd = syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+  }
+  return fd;
+}
+
+PerfCounters::PerfCounters(pid_t pid)
+{
+  static const unsigned long long hardware[] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+  };
+  static const unsigned long long software[] = {
+    PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_COUNT_SW_PAGE_FAULTS
+  };
+  for (int i = 0; i < COUNTERS; i++)
+  {
+    fds[i] = -1;
+  }
+  for (int i = CYCLES; i <= BRANCH_MISSES; i++)
+  {
+    fds[i] = _openPerfCounter(pid, PERF_TYPE_HARDWARE, hardware[i - CYCLES]);
+    if (fds[i] == -1) // no PMU (e.g. a VM) or not allowed - the rest would fail the same way
+      break;
+  }
+  for (int i = TASK_CLOCK; i <= PAGE_FAULTS; i++)
+  {
+    fds[i] = _openPerfCounter(pid, PERF_TYPE_SOFTWARE, software[i - TASK_CLOCK]);
+  }
+}
+
+PerfCounters::~PerfCounters()
+{
+  for (int i = 0; i < COUNTERS; i++)
+  {
+    if (fds[i] != -1)
+      close(fds[i]);
+  }
+}
+
+bool PerfCounters::isOpen() const
+{
+  for (int i = 0; i < COUNTERS; i++)
+  {
+    if (fds[i] != -1)
+      return true;
+  }
+  return false;
+}
+
+bool PerfCounters::hasHardware() const
+{
+  return fds[CYCLES] != -1;
+}
+
+PerfCounters::Totals PerfCounters::read() const
+{
+  Totals totals;
+  totals.counted = isOpen();
+  for (int i = 0; i < COUNTERS; i++)
+  {
+    totals.values[i] = -1;
+    unsigned long long data[3]; // value, time enabled, time running
+    if (fds[i] == -1 || ::read(fds[i], data, sizeof(data)) != sizeof(data))
+      continue;
+    if (data[2] != 0 && data[2] < data[1])
+      totals.values[i] = (long long)((double)data[0] * data[1] / data[2]);
+    else
+      totals.values[i] = (long long)data[0];
+  }
+  return totals;
+}
+
+std::string PerfCounters::format(const Totals& totals)
+{
+  std::ostringstream out;
+  for (int i = 0; i < COUNTERS; i++)
+  {
+    out << (i > 0 ? " " : "") << PERF_COUNTER_NAMES[i] << " ";
+    if (totals.values[i] == -1)
+      out << "-";
+    else if (i == TASK_CLOCK)
+      out << std::fixed << std::setprecision(3) << totals.values[i] / 1e6 << "ms";
+    else
+      out << totals.values[i];
+    if (i == INSTRUCTIONS && totals.values[CYCLES] > 0 && totals.values[INSTRUCTIONS] != -1)
+      out << " ipc " << std::fixed << std::setprecision(2) << (double)totals.values[INSTRUCTIONS] / totals.values[CYCLES];
+  }
+  return out.str();
+}
+
+PerfStatCommand::PerfStatCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
+
+void PerfStatCommand::execute()
+{
+  SmallShell& smash = SmallShell::getInstance();
+  if (c_num_of_args == 1)
+  {
+    cout << "perfstat: " << (smash.isPerfOn() ? "on" : "off") << endl;
+    return;
+  }
+  if (c_num_of_args == 2 && strcmp(c_args[1], "off") == 0)
+  {
+    smash.setPerf(false);
+    return;
+  }
+  if (c_num_of_args == 2 && strcmp(c_args[1], "on") == 0)
+  {
+    PerfCounters probe(0); // what the kernel lets us count
+    if (!probe.isOpen())
+    {
+      perror("smash error: perf_event_open failed");
+      return;
+    }
+    if (!probe.hasHardware())
+    {
+      cout << "perfstat: no hardware counters, counting software events only" << endl;
+    }
+    smash.setPerf(true);
+    return;
+  }
+  std::cerr << "smash error: perfstat: invalid arguments" << std::endl;
+}
+/******************PERF COUNTERS*/
+
+/*EXTERNAL COMMAND***************/
+// while the time built-in runs, the parent learns when the son exec'ed: the son holds the write
+// end of a close-on-exec pipe, so a read on the other end returns EOF as soon as exec succeeds
+static void _openExecProbe(int probe[2])
+{
+  probe[0] = -1;
+  probe[1] = -1;
+  if (SmallShell::getInstance().isExecTiming() && pipe2(probe, O_CLOEXEC) == -1)
+  {
+    probe[0] = -1;
+    probe[1] = -1;
+  }
+}
+
+static void _waitExecProbe(int probe[2], double fork_time, bool forked)
+{
+  if (probe[0] == -1)
+    return;
+  close(probe[1]);
+  if (forked)
+  {
+    char c;
+    while (read(probe[0], &c, 1) == -1 && errno == EINTR) {}
+    SmallShell::getInstance().addExecLatency(_monotonicSeconds() - fork_time);
+  }
+  close(probe[0]);
+}
+
+// with perf counters on, the son waits for EOF on a gate pipe until the smash has attached them,
+// so enable_on_exec can not miss its exec
+static void _openPerfGate(int gate[2])
+{
+  gate[0] = -1;
+  gate[1] = -1;
+  if (SmallShell::getInstance().isPerfOn() && pipe2(gate, O_CLOEXEC) == -1)
+  {
+    gate[0] = -1;
+    gate[1] = -1;
+  }
+}
+
+static void _passPerfGate(int gate[2])
+{
+  if (gate[0] == -1)
+    return;
+  close(gate[1]);
+  char c;
+  while (read(gate[0], &c, 1) == -1 && errno == EINTR) {}
+  close(gate[0]);
+}
+
+// in the parent: p == -1 if the fork failed
+static void _releasePerfGate(int gate[2], pid_t p, JobsList* jobs)
+{
+  if (gate[0] == -1)
+    return;
+  if (p > 0)
+    jobs->attachPerfCounters(p);
+  close(gate[0]);
+  close(gate[1]);
+}
+
+static const double TIMEOUT_GRACE = 1; // seconds from SIGTERM to SIGKILL when timeout has no -k
+static const double TIMEOUT_MAX = 100 * 365 * 24 * 3600.0; // the timers take a time_t of seconds
+static const double SHUTDOWN_GRACE = 1; // quit kill: seconds from SIGTERM to SIGKILL, and then to giving up
+
+// "250ms", "1.5", "2m": a number of seconds with an optional s / ms / m / h unit
+static bool _parseDuration(const std::string& word, double* seconds)
+{
+  // decimal digits with an optional fraction only, strtod would also take hex and exponents
+  size_t number_end = word.find_first_not_of("0123456789.");
+  std::string number = word.substr(0, number_end);
+  if (number.empty() || !std::isdigit(number[0]) || number.find('.') != number.rfind('.'))
+    return false;
+  double value = strtod(number.c_str(), nullptr);
+  std::string suffix = (number_end == string::npos) ? "" : word.substr(number_end);
+  if (suffix == "" || suffix == "s")
+    *seconds = value;
+  else if (suffix == "ms")
+    *seconds = value / 1000;
+  else if (suffix == "m")
+    *seconds = value * 60;
+  else if (suffix == "h")
+    *seconds = value * 3600;
+  else
+    return false;
+  return *seconds <= TIMEOUT_MAX;
+}
+
+ExternalCommand::ExternalCommand(const char *cmd_line, JobsList* jobs) : Command(cmd_line), c_jobs(jobs) {}  //changed
+void ExternalCommand::execute()
+{
+  if (c_args[0] == nullptr)
+  {
+    return;
+  }
+  SmallShell& smash = SmallShell::getInstance();
+  bool is_bg = _isBackgroundComamnd(c_cmd_line.c_str());
+  const char* cmd_line = c_cmd_line.c_str();
+  int status = 0;
+  char* ex_cmd_line; 
+  bool is_timed = false;
+  double duration = 0;
+  double grace = TIMEOUT_GRACE;
+  
+  if (strcmp(c_args[0],"timeout") == 0)//case is timeout command: timeout [-k grace] duration command
+  {
+    string fixed_cmd = _trim(c_cmd_line).substr(strlen("timeout"));
+    string word = _takeWord(fixed_cmd);
+    bool valid = true;
+    if (word == "-k")
+    {
+      valid = _parseDuration(_takeWord(fixed_cmd), &grace);
+      word = _takeWord(fixed_cmd);
+    }
+    fixed_cmd = _trim(fixed_cmd);
+    if (!valid || !_parseDuration(word, &duration) || duration <= 0 || fixed_cmd.empty()) //handle wrong syntax of timeout
+    {
+      cerr << "smash error: timeout: invalid arguments" << endl;
+      return;
+    }
+    is_timed = true;
+
+    ex_cmd_line = new char[fixed_cmd.size()+1];
+    strcpy(ex_cmd_line, fixed_cmd.c_str());
+  }
+  else{
+    ex_cmd_line = new char[strlen(cmd_line)+1]; //create a non-const version of cmd_line //needs to be delete
+    strcpy(ex_cmd_line,cmd_line);
+  }
+  _removeBackgroundSign(ex_cmd_line);
+  std::vector<std::string> argv; // globs are expanded here, so the listing cache of the smash is used
+  if (!_buildDirectArgv(ex_cmd_line, argv))
+  {
+    argv.clear(); // bash runs it
+  }
+  int probe[2];
+  _openExecProbe(probe);
+  int gate[2];
+  _openPerfGate(gate);
+  c_start_time = _monotonicSeconds();
+  int pidfd;
+  pid_t p = _forkWithPidFd(&pidfd);
+  if(p == -1)
+  {
+    perror("smash error: fork failed");
+    _releasePerfGate(gate, p, c_jobs);
+    _waitExecProbe(probe, c_start_time, false);
+    delete[] ex_cmd_line;
+    return;
+  }
+  else 
+  {
+    if (p == 0) // son
+    {
+      setpgrp();
+      _passPerfGate(gate);
+      execChild(ex_cmd_line, argv);
+    }
+    if(p > 0) // parent
+    { 
+      double forked = _monotonicSeconds();
+      setPidFd(pidfd);
+      setpgid(p, p); // like the son's setpgrp, so the group exists before the son has run
+      _releasePerfGate(gate, p, c_jobs);
+      smash.recordStat(STAT_FORK, forked - c_start_time);
+      smash.getTracer().instant("fork", "pid", p, c_cmd_line.c_str());
+      _waitExecProbe(probe, c_start_time, true);
+      delete[] ex_cmd_line;
+      TimedList& s_list = smash.getTimedList();
+      if (is_timed && s_list.addTimedEntry(p, c_cmd_line, duration, grace, c_pidfd) == nullptr)
+      {
+        // never run a timed command without its timer
+        perror("smash error: timer_create failed");
+        kill(-p, SIGKILL);
+        waitpid(p, nullptr, 0);
+        return;
+      }
+    
+      c_pid = p;
+      smash.setCurrentPid(p);
+      smash.setCurrentCommand(this);
+
+      if (is_bg)
+      {
+        smash.setWaitEnd(forked);
+        c_jobs->addJob(this);
+        smash.setCurrentPid(-1);
+      }
+      else  //foreground
+      {  
+        struct rusage usage;
+        // also return if child 'p' was STOPPED
+        if (wait4(p, &status, WUNTRACED, &usage) == p && !WIFSTOPPED(status))
+        {
+          c_jobs->recordFinished(0, getJobLine(), p, c_start_time, status, usage);
+          s_list.finishTimedEntry(p);
+        }
+        double waited = _monotonicSeconds();
+        smash.recordStat(STAT_RUN, waited - forked);
+        smash.setWaitEnd(waited);
+        smash.getTracer().instant("wait", "pid", p);
+        smash.getTracer().complete("process", c_start_time * 1e9, waited * 1e9, c_cmd_line.c_str(), p);
+      }
+    }
+  }
+}
+
+bool ExternalCommand::isTimeout() const
+{
+  return c_args[0] != nullptr && strcmp(c_args[0], "timeout") == 0;
+}
+
+void ExternalCommand::execChild(char* ex_cmd_line, const std::vector<std::string>& argv)
+{
+  // the son starts from a clean signal mask even if the smash blocked something around the fork
+  sigset_t none;
+  sigemptyset(&none);
+  sigprocmask(SIG_SETMASK, &none, nullptr);
+  Tracer& tracer = SmallShell::getInstance().getTracer(); // the ring is shared with the smash
+  if (c_in_fd != STDIN_FILENO || c_out_fd != STDOUT_FILENO || c_err_fd != STDERR_FILENO)
+    tracer.instant("dup2", nullptr, 0, c_cmd_line.c_str());
+  if ((c_in_fd != STDIN_FILENO && dup2(c_in_fd, STDIN_FILENO) == -1) ||
+      (c_out_fd != STDOUT_FILENO && dup2(c_out_fd, STDOUT_FILENO) == -1) ||
+      (c_err_fd != STDERR_FILENO && dup2(c_err_fd, STDERR_FILENO) == -1))
+  {
+    perror("smash error: dup2 failed");
+    exit(1);
+  }
+  const SchedSettings& sched = SmallShell::getInstance().getLaunchSched();
+  if (sched.isSet() && !sched.apply(0))
+  {
+    exit(1);
+  }
+  if (!argv.empty()) // a simple command - exec it directly, skipping bash
+  {
+    std::vector<char*> direct_args;
+    for (size_t i = 0; i < argv.size(); i++)
+    {
+      direct_args.push_back(const_cast<char*>(argv[i].c_str()));
+    }
+    direct_args.push_back(nullptr);
+    tracer.instant("exec", nullptr, 0, direct_args[0]);
+    execvp(direct_args[0], &direct_args[0]);
+    // not a program (e.g. a bash built-in like ulimit) - let bash handle it below
+  }
+  _removeBackgroundSign(ex_cmd_line); //remove & from arguments
+  char* bash_args[] = {(char *)"/bin/bash",(char *)"-c", ex_cmd_line, NULL};
+  tracer.instant("exec", nullptr, 0, "/bin/bash");
+  execv("/bin/bash", bash_args);
+  perror("smash error: execv failed");
+  exit(1);
+}
+
+pid_t ExternalCommand::spawn()
+{
+  char* ex_cmd_line = new char[c_cmd_line.size() + 1];
+  strcpy(ex_cmd_line, c_cmd_line.c_str());
+  _removeBackgroundSign(ex_cmd_line);
+  std::vector<std::string> argv;
+  if (!_buildDirectArgv(ex_cmd_line, argv))
+  {
+    argv.clear(); // bash runs it
+  }
+  int probe[2];
+  _openExecProbe(probe);
+  int gate[2];
+  _openPerfGate(gate);
+  double fork_time = _monotonicSeconds();
+  int pidfd;
+  pid_t p = _forkWithPidFd(&pidfd);
+  if (p == -1)
+  {
+    perror("smash error: fork failed");
+    _releasePerfGate(gate, p, c_jobs);
+    _waitExecProbe(probe, fork_time, false);
+    delete[] ex_cmd_line;
+    return -1;
+  }
+  if (p == 0)
+  {
+    setpgrp();
+    _passPerfGate(gate);
+    execChild(ex_cmd_line, argv);
+  }
+  SmallShell::getInstance().recordStat(STAT_FORK, _monotonicSeconds() - fork_time);
+  setPidFd(pidfd);
+  setpgid(p, p); // like the son's setpgrp, so the group exists before the son has run
+  _releasePerfGate(gate, p, c_jobs);
+  SmallShell::getInstance().getTracer().instant("fork", "pid", p, c_cmd_line.c_str());
+  _waitExecProbe(probe, fork_time, true);
+  delete[] ex_cmd_line;
+  c_pid = p;
+  return p;
+}
+/******************EXTERNAL COMMAND*/
+
+/*REDIRECTION COMMAND***************/
+
+RedirectionCommand::RedirectionCommand(const char* cmd_line): Command(cmd_line) {}
+
+// splits the command line into the command and its redirections (in their order)
+bool RedirectionCommand::parse()
+{
+  char* no_bg_line = new char[c_cmd_line.size() + 1];
+  strcpy(no_bg_line, c_cmd_line.c_str());
+  bool is_bg = _isBackgroundComamnd(no_bg_line);
+  _removeBackgroundSign(no_bg_line); // "cmd > f&" - the & is not part of the file name
+  std::string line = no_bg_line;
+  delete[] no_bg_line;
+
+  std::string command;
+  size_t i = 0;
+  while (i < line.size())
+  {
+    int fd = -2; // -2: no redirection starts here
+    size_t op_start = i;
+    bool word_start = (i == 0 || isspace((unsigned char)line[i - 1]));
+    if (word_start && line[i] >= '0' && line[i] <= '2' && i + 1 < line.size() && (line[i + 1] == '>' || line[i + 1] == '<'))
+    {
+      fd = line[i] - '0';
+      op_start = i + 1;
+    }
+    else if (line.compare(i, 2, "&>") == 0)
+    {
+      fd = -1;
+      op_start = i + 1;
+    }
+    else if (line[i] == '>' || line[i] == '<')
+    {
+      fd = (line[i] == '<') ? 0 : 1;
+    }
+    if (fd == -2)
+    {
+      command += line[i++];
+      continue;
+    }
+
+    Redirect redirect;
+    redirect.fd = fd;
+    if (line.compare(op_start, 3, "<<<") == 0)
+      redirect.op = "<<<";
+    else if (line.compare(op_start, 2, ">>") == 0 || line.compare(op_start, 2, ">&") == 0 || line.compare(op_start, 2, "<&") == 0)
+      redirect.op = line.substr(op_start, 2);
+    else
+      redirect.op = line.substr(op_start, 1);
+    if ((redirect.op[0] == '<') != (fd == 0) || (fd == -1 && redirect.op == ">&"))
+      return false; // 1<file, 0>file, &>&1
+    size_t start = line.find_first_not_of(WHITESPACE, op_start + redirect.op.size());
+    if (start == string::npos)
+      return false;
+    size_t end;
+    if (redirect.op == "<<<") // the rest of the line, up to the next redirection
+    {
+      end = line.find_first_of("<>", start);
+      if (end == string::npos)
+        end = line.size();
+      else if (end - 1 > start && (line[end - 1] == '&' || isdigit((unsigned char)line[end - 1])) && isspace((unsigned char)line[end - 2]))
+        end--;
+    }
+    else
+    {
+      end = line.find_first_of(WHITESPACE + "<>", start);
+      if (end == string::npos)
+        end = line.size();
+    }
+    redirect.target = _trim(line.substr(start, end - start));
+    if (redirect.op == "<<<" && redirect.target.size() >= 2 && (redirect.target[0] == '\'' || redirect.target[0] == '"') &&
+        redirect.target[redirect.target.size() - 1] == redirect.target[0]) // no quoting in the smash, but <<< "a b" is common
+    {
+      redirect.target = redirect.target.substr(1, redirect.target.size() - 2);
+    }
+    redirects.push_back(redirect);
+    command += ' ';
+    i = end;
+  }
+  inner_cmd_line = _trim(command);
+  if (inner_cmd_line.empty() || redirects.empty())
+    return false;
+  if (is_bg)
+    inner_cmd_line += "&";
+  return true;
+}
+
+// a here-string is a memfd holding the text and a newline, so reading it costs no process
+static int _hereString(const std::string& text)
+{
+  int fd = memfd_create("smash-here-string", MFD_CLOEXEC);
+  if (fd == -1)
+  {
+    perror("smash error: memfd_create failed");
+    return -1;
+  }
+  std::string data = text + "\n";
+  if (!_writeAll(fd, data.data(), data.size()) || lseek(fd, 0, SEEK_SET) == -1)
+  {
+    perror("smash error: write failed");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// opens every redirection in order into fds[0..2] (-1: not redirected). all of them are new
+// close-on-exec fds, also the ones copied from another fd or an exec slot
+bool RedirectionCommand::openRedirects(int fds[3])
+{
+  SmallShell& smash = SmallShell::getInstance();
+  for (size_t i = 0; i < redirects.size(); i++)
+  {
+    const Redirect& redirect = redirects[i];
+    int fd;
+    if (redirect.op == "<")
+    {
+      fd = open(redirect.target.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    else if (redirect.op == ">" || redirect.op == ">>")
+    {
+      fd = open(redirect.target.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC | (redirect.op == ">>" ? O_APPEND : O_TRUNC), 0655);
+    }
+    else if (redirect.op == "<<<")
+    {
+      fd = _hereString(redirect.target);
+      if (fd == -1)
+        return false;
+    }
+    else // >&M, <&M: a copy of fd M (as redirected so far) or of exec slot M
+    {
+      if (!isANumber(redirect.target.c_str()))
+      {
+        std::cerr << "smash error: redirection: invalid arguments" << std::endl;
+        return false;
+      }
+      int from = atoi(redirect.target.c_str());
+      int source = (from <= 2) ? (fds[from] != -1 ? fds[from] : from) : smash.getFdSlot(from);
+      if (source == -1)
+      {
+        std::cerr << "smash error: " << from << ": Bad file descriptor" << std::endl;
+        return false;
+      }
+      fd = fcntl(source, F_DUPFD_CLOEXEC, 3);
+    }
+    if (fd == -1)
+    {
+      perror(redirect.op[1] == '&' ? "smash error: fcntl failed" : "smash error: open failed");
+      return false;
+    }
+    int first = (redirect.fd == -1) ? 1 : redirect.fd;
+    if (fds[first] != -1)
+      close(fds[first]);
+    fds[first] = fd;
+    if (redirect.fd == -1) // &> - stderr gets its own copy
+    {
+      if (fds[2] != -1)
+        close(fds[2]);
+      fds[2] = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+      if (fds[2] == -1)
+      {
+        perror("smash error: fcntl failed");
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void RedirectionCommand::execute()
+{
+  if (!parse())
+  {
+    std::cerr << "smash error: redirection: invalid arguments" << std::endl;
+    return;
+  }
+  int fds[3] = {-1, -1, -1};
+  if (!openRedirects(fds))
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      if (fds[i] != -1)
+        close(fds[i]);
+    }
+    return;
+  }
+
+  SmallShell& smash = SmallShell::getInstance();
+  smash.getTracer().instant("redirect", nullptr, 0, c_cmd_line.c_str());
+  int own[3] = {c_in_fd, c_out_fd, c_err_fd};
+  for (int k = 0; k < 3; k++) // a slot that is not redirected keeps the fd given to the command (bench -q)
+  {
+    if (fds[k] == -1 && own[k] != k && (fds[k] = fcntl(own[k], F_DUPFD_CLOEXEC, 3)) == -1)
+      perror("smash error: fcntl failed");
+  }
+  Command* inner = smash.CreateCommand(inner_cmd_line.c_str());
+  bool is_bg = _isBackgroundComamnd(inner_cmd_line.c_str());
+  if (fds[0] != -1)
+    inner->setInFd(fds[0]);
+  if (fds[1] != -1)
+    inner->setOutFd(fds[1]);
+  if (fds[2] != -1)
+    inner->setErrFd(fds[2]);
+  inner->setOwnsFds(true);
+  inner->setJobLine(getJobLine()); // as a job, the inner command shows the whole line
+
+  // built-ins print their errors (and the non data ones everything) through the smash's own
+  // fds, those are switched around a foreground built-in and switched back right after
+  BuiltInCommand* built_in = dynamic_cast<BuiltInCommand*>(inner);
+  bool in_background = built_in != nullptr && is_bg && built_in->canRunInBackground();
+  int saved[3] = {-1, -1, -1};
+  for (int k = 1; k <= 2 && built_in != nullptr && !in_background; k++)
+  {
+    if (fds[k] == -1 || (k == 1 && built_in->canRunInPipe()))
+      continue;
+    std::cout.flush();
+    saved[k] = fcntl(k, F_DUPFD_CLOEXEC, 3);
+    if (saved[k] == -1 || dup2(fds[k], k) == -1)
+    {
+      perror("smash error: dup2 failed");
+    }
+  }
+
+  smash.runCommand(inner, is_bg);
+
+  for (int k = 1; k <= 2; k++)
+  {
+    if (saved[k] == -1)
+      continue;
+    std::cout.flush();
+    if (dup2(saved[k], k) == -1)
+    {
+      perror("smash error: dup2 failed");
+    }
+    close(saved[k]);
+  }
+}
+/******************REDIRECTION COMMAND*/
+
+/*EXEC COMMAND***************/
+#define EXEC_MIN_SLOT 3 // 0-2 are the smash's own standard fds
+#define EXEC_MAX_SLOT 9
+
+ExecCommand::ExecCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
+
+// exec N>file N>>file N<file N>&- N<&- ... (spaces after the operator are allowed)
+void ExecCommand::execute()
+{
+  SmallShell& smash = SmallShell::getInstance();
+  std::string specs = _trim(c_cmd_line.substr(c_cmd_line.find("exec") + 4));
+  size_t pos = 0;
+  if (specs.empty())
+  {
+    std::cerr << "smash error: exec: invalid arguments" << std::endl;
+    return;
+  }
+  while (pos < specs.size())
+  {
+    size_t op = specs.find_first_not_of("0123456789", pos);
+    if (op == pos || op == string::npos || op - pos > 1 || (specs[op] != '>' && specs[op] != '<'))
+    {
+      std::cerr << "smash error: exec: invalid arguments" << std::endl;
+      return;
+    }
+    int slot = specs[pos] - '0';
+    if (slot < EXEC_MIN_SLOT || slot > EXEC_MAX_SLOT)
+    {
+      std::cerr << "smash error: exec: fd slots are " << EXEC_MIN_SLOT << "-" << EXEC_MAX_SLOT << std::endl;
+      return;
+    }
+    std::string oper = specs.substr(op, 1);
+    if (op + 1 < specs.size() && (specs[op + 1] == '>' || specs[op + 1] == '&') && oper == ">")
+      oper += specs[op + 1];
+    else if (op + 1 < specs.size() && specs[op + 1] == '&' && oper == "<")
+      oper += '&';
+    size_t target_start = specs.find_first_not_of(WHITESPACE, op + oper.size());
+    if (target_start == string::npos)
+    {
+      std::cerr << "smash error: exec: invalid arguments" << std::endl;
+      return;
+    }
+    size_t target_end = specs.find_first_of(WHITESPACE, target_start);
+    std::string target = specs.substr(target_start, target_end == string::npos ? string::npos : target_end - target_start);
+    pos = (target_end == string::npos) ? specs.size() : specs.find_first_not_of(WHITESPACE, target_end);
+
+    if (oper == ">&" || oper == "<&")
+    {
+      if (target != "-")
+      {
+        std::cerr << "smash error: exec: invalid arguments" << std::endl;
+        return;
+      }
+      if (!smash.closeFdSlot(slot))
+      {
+        std::cerr << "smash error: " << slot << ": Bad file descriptor" << std::endl;
+      }
+      continue;
+    }
+    int flags = (oper == "<") ? O_RDONLY : O_CREAT | O_WRONLY | (oper == ">>" ? O_APPEND : O_TRUNC);
+    int fd = open(target.c_str(), flags | O_CLOEXEC, 0655);
+    if (fd == -1)
+    {
+      perror("smash error: open failed");
+      return;
+    }
+    smash.setFdSlot(slot, fd);
+  }
+}
+/******************EXEC COMMAND*/
+
+/*PIPE COMMANDS***************/
+
+enum { STAGE_EXTERNAL, STAGE_IN_PROCESS, STAGE_FORKED };
+
+// how a pipe stage is run: external commands are exec'ed straight from a son of the smash,
+// data built-ins run inside the smash, anything else (timeout, state changing built-ins as
+// the writer) keeps running in a forked smash
+static int _pipeStageKind(Command* cmd, bool is_writer, bool ch_stdout)
+{
+  ExternalCommand* external = dynamic_cast<ExternalCommand*>(cmd);
+  if (external != nullptr)
+  {
+    return external->isTimeout() ? STAGE_FORKED : STAGE_EXTERNAL;
+  }
+  if (!is_writer)
+  {
+    return STAGE_IN_PROCESS;
+  }
+  BuiltInCommand* built_in = dynamic_cast<BuiltInCommand*>(cmd);
+  // built-ins report errors through perror, so "|&" still needs fd 2 of a forked smash
+  if (built_in != nullptr && built_in->canRunInPipe() && ch_stdout)
+  {
+    return STAGE_IN_PROCESS;
+  }
+  return STAGE_FORKED;
+}
+
+// runs a built-in stage on the calling thread with SIGPIPE blocked, so a reader that exits
+// early makes the writes fail with EPIPE instead of killing the smash
+static void _runStageInProcess(Command* cmd)
+{
+  SmallShell &smash = SmallShell::getInstance();
+  sigset_t pipe_set, old;
+  sigemptyset(&pipe_set);
+  sigaddset(&pipe_set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe_set, &old);
+  smash.setForegroundBuiltIn(cmd);
+  cmd->execute();
+  smash.setForegroundBuiltIn(nullptr);
+  struct timespec no_wait = {0, 0};
+  while (sigtimedwait(&pipe_set, nullptr, &no_wait) > 0) {} // drop the SIGPIPE we caused
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+}
+
+PipeCommand::PipeCommand(const char* cmd_line, bool _ch_stdout, size_t _pos): Command(cmd_line), ch_stdout(_ch_stdout), pos(_pos) {}
+void PipeCommand::execute()
+{
+  //divide the cmd line to its command 1 and command 2
+  size_t x = (ch_stdout == true) ? 3 : 4;
+  std::string cmd_1 = c_cmd_line.substr(0,pos);
+  std::string cmd_2 = c_cmd_line.substr(pos+x ,c_cmd_line.size() - cmd_1.size() - x);
+  bool is_bg = _isBackgroundComamnd(c_cmd_line.c_str());
+  double start_time = _monotonicSeconds();
+  
+  SmallShell &smash = SmallShell::getInstance();
+  int my_pipe[2]; // close-on-exec, the sons get their ends through dup2
+  if (pipe2(my_pipe, O_CLOEXEC) == -1)
+  {
+    perror("smash error: pipe failed");
+    return;
+  }
+  Command* first = smash.CreateCommand(cmd_1.c_str());
+  Command* second = smash.CreateCommand(cmd_2.c_str());
+  int first_kind = _pipeStageKind(first, true, ch_stdout);
+  int second_kind = _pipeStageKind(second, false, ch_stdout);
+
+  first->setInFd(c_in_fd);
+  first->setOutFd(ch_stdout ? my_pipe[1] : c_out_fd); // " | " - cmd1 stdout -> pipe's write channel
+  first->setErrFd(ch_stdout ? c_err_fd : my_pipe[1]); // " |& " - cmd1 stderr -> pipe's write channel
+  second->setInFd(my_pipe[0]);
+  second->setOutFd(c_out_fd);
+  second->setErrFd(c_err_fd);
+
+  pid_t p1 = -1, p2 = -1;
+  int first_status = 0;
+  bool first_waited = false; // the writer was waited for already, by an in-process reader
+  if (first_kind == STAGE_EXTERNAL)
+  {
+    p1 = static_cast<ExternalCommand*>(first)->spawn();
+  }
+  else if (first_kind == STAGE_FORKED)
+  {
+    int pidfd;
+    p1 = _forkWithPidFd(&pidfd);
+    if (p1 == -1)
+    {
+      perror("smash error: fork failed");
+    }
+    if (p1 > 0)
+    {
+      first->setPidFd(pidfd);
+    }
+    if (p1 == 0) // son = execute command 1 in a copy of the smash
+    {
+      setpgrp();
+      smash.setIsPiped(true);
+      smash.forgetThreadPool();
+      if (dup2(first->getOutFd(), STDOUT_FILENO) == -1 || dup2(first->getErrFd(), STDERR_FILENO) == -1 ||
+          (c_in_fd != STDIN_FILENO && dup2(c_in_fd, STDIN_FILENO) == -1))
+      {
+        perror("smash error: dup2 failed");
+        exit(1);
+      }
+      smash.executeCommand(cmd_1.c_str());
+      exit(0);
+    }
+  }
+  if (first_kind != STAGE_IN_PROCESS && close(my_pipe[1]) == -1) // close smash's pipe's write channel
+  {
+    perror("smash error: close failed");
+  }
+  if (second_kind == STAGE_EXTERNAL)
+  {
+    p2 = static_cast<ExternalCommand*>(second)->spawn();
+  }
+  else if (second_kind == STAGE_FORKED)
+  {
+    int pidfd;
+    p2 = _forkWithPidFd(&pidfd);
+    if (p2 == -1)
+    {
+      perror("smash error: fork failed");
+    }
+    if (p2 > 0)
+    {
+      second->setPidFd(pidfd);
+    }
+    if (p2 == 0) // son = execute command 2 in a copy of the smash
+    {
+      setpgrp();
+      smash.setIsPiped(true);
+      smash.forgetThreadPool();
+      if (first_kind == STAGE_IN_PROCESS) // the smash keeps the write channel, the son must not
+      {
+        close(my_pipe[1]);
+      }
+      if (dup2(my_pipe[0], STDIN_FILENO) == -1 ||
+          (c_out_fd != STDOUT_FILENO && dup2(c_out_fd, STDOUT_FILENO) == -1) ||
+          (c_err_fd != STDERR_FILENO && dup2(c_err_fd, STDERR_FILENO) == -1))
+      {
+        perror("smash error: dup2 failed");
+        exit(1);
+      }
+      smash.executeCommand(cmd_2.c_str());
+      exit(0);
+    }
+  }
+  if (second_kind != STAGE_IN_PROCESS && close(my_pipe[0]) == -1) // close smash's pipe's read channel
+  {
+    perror("smash error: close failed");
+  }
+
+  if (first_kind == STAGE_IN_PROCESS && second_kind != STAGE_IN_PROCESS) // the smash writes, the son reads
+  {
+    _runStageInProcess(first);
+    close(my_pipe[1]);
+  }
+  else if (first_kind == STAGE_IN_PROCESS) // both in-process: the writer gets a pool thread
+  {
+    std::shared_ptr<BuiltInTask> writer(new BuiltInTask(first));
+    first = nullptr; // owned by the task now
+    int write_fd = my_pipe[1];
+    smash.getThreadPool()->submit([writer, write_fd]() {
+      writer->run();
+      close(write_fd);
+    });
+    _runStageInProcess(second);
+    close(my_pipe[0]); // a writer still blocked on a full pipe gets EPIPE
+    writer->waitFinished();
+    _addPoolUsage(writer->getUsage());
+  }
+  else if (second_kind == STAGE_IN_PROCESS) // a son writes, the smash reads
+  {
+    // the reader gets a pool thread while the smash waits for the writer, so ctrl-Z can stop
+    // it: the line becomes a job and the reader goes on in the background, on fds of its own
+    int read_fd = my_pipe[0];
+    int out_fd = c_out_fd == STDOUT_FILENO ? c_out_fd : fcntl(c_out_fd, F_DUPFD_CLOEXEC, 3);
+    int err_fd = c_err_fd == STDERR_FILENO ? c_err_fd : fcntl(c_err_fd, F_DUPFD_CLOEXEC, 3);
+    if (out_fd == -1 || err_fd == -1)
+    {
+      perror("smash error: fcntl failed");
+    }
+    second->setOutFd(out_fd);
+    second->setErrFd(err_fd);
+    std::shared_ptr<BuiltInTask> reader(new BuiltInTask(second));
+    second = nullptr; // owned by the task now
+    smash.getThreadPool()->submit([reader, read_fd, out_fd, err_fd]() {
+      reader->run();
+      close(read_fd); // a writer still blocked on a full pipe gets EPIPE
+      if (out_fd != STDOUT_FILENO)
+        close(out_fd);
+      if (err_fd != STDERR_FILENO)
+        close(err_fd);
+    });
+    first->setJobLine(getJobLine()); // a stopped writer is listed as the whole line
+    smash.setCurrentPid(p1); // ctrl-C kills the writer, the reader then sees EOF
+    smash.setCurrentCommand(first);
+    smash.setForegroundBuiltIn(reader->getCommand());
+    struct rusage usage;
+    if (p1 > 0 && !is_bg && wait4(p1, &first_status, WUNTRACED, &usage) == p1)
+    {
+      first_waited = true;
+      if (!WIFSTOPPED(first_status))
+      {
+        smash.getJobsList()->recordFinished(0, first->getCmdLine(), p1, start_time, first_status, usage);
+        smash.getTracer().instant("wait", "pid", p1);
+        smash.getTracer().complete("process", start_time * 1e9, Tracer::now(), first->getCmdLine().c_str(), p1);
+      }
+    }
+    smash.setCurrentPid(-1);
+    if (!first_waited || !WIFSTOPPED(first_status))
+    {
+      reader->waitFinished(); // ctrl-C now cancels the reader
+      _addPoolUsage(reader->getUsage());
+    }
+    smash.setForegroundBuiltIn(nullptr);
+  }
+
+  int status = 0;
+  if (p2 > 0)
+  {
+    second->setPid(p2);
+    second->setStartTime(start_time);
+    if (is_bg)
+    {
+      smash.setWaitEnd(_monotonicSeconds());
+      smash.getJobsList()->addJob(second);
+    }
+    else
+    {
+      smash.setCurrentPid(p2);
+      smash.setCurrentCommand(second);
+      struct rusage usage;
+      // also return if it was STOPPED
+      if (wait4(p2, &status, WUNTRACED, &usage) == p2 && !WIFSTOPPED(status))
+      {
+        smash.getJobsList()->recordFinished(0, second->getCmdLine(), p2, start_time, status, usage);
+      }
+      smash.getTracer().instant("wait", "pid", p2);
+      smash.getTracer().complete("process", start_time * 1e9, Tracer::now(), second->getCmdLine().c_str(), p2);
+      smash.setCurrentPid(-1);
+    }
+  }
+  if (p1 > 0 && !is_bg && !first_waited && !(p2 > 0 && WIFSTOPPED(status)))
+  {
+    struct rusage usage;
+    if (wait4(p1, &first_status, 0, &usage) == p1)
+    {
+      smash.getJobsList()->recordFinished(0, first->getCmdLine(), p1, start_time, first_status, usage);
+    }
+    smash.getTracer().instant("wait", "pid", p1);
+    smash.getTracer().complete("process", start_time * 1e9, Tracer::now(), first->getCmdLine().c_str(), p1);
+  }
+  if (!is_bg) // in-process stages are done by now too
+  {
+    double waited = _monotonicSeconds();
+    smash.recordStat(STAT_RUN, waited - start_time);
+    smash.setWaitEnd(waited);
+  }
+  delete first;
+  delete second;
+}
+/******************PIPE COMMANDS*/
+
+/*TAIL COMMAND***************/
+TailCommand::TailCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
+bool TailCommand::canRunInBackground() const
+{
+  return true;
+}
+
+bool TailCommand::canRunInPipe() const
+{
+  return true;
+}
+
+void TailCommand::execute()
+{
+  if (c_num_of_args > 3 || c_num_of_args < 2)
+  {
+    std::cerr << "smash error: tail: invalid arguments" << std::endl;
+    return;
+  }
+
+  const char* minus_N = c_args[1]; 
+  char* last_lines = (char*)malloc(strlen(minus_N));
+  strcpy(last_lines, minus_N+1);
+  
+  if (c_num_of_args == 3 && ( (minus_N[0] != '-') || (!isANumber(last_lines)) ) )
+  {
+    std::cerr << "smash error: tail: invalid arguments" << std::endl;
+    free(last_lines); 
+    return;
+  }
+  int num_lines;
+  char* file_path;
+  if(c_num_of_args == 2)
+  {
+    num_lines = N;
+    file_path = c_args[1];
+  }
+  else //3 args
+  {
+    file_path = c_args[2];
+    num_lines= atoi(last_lines);   
+  }
+  free(last_lines);
+
+  std::vector<std::string> files = _expandGlob(file_path);
+  for (size_t i = 0; i < files.size() && !isCancelled(); i++)
+  {
+    if (files.size() > 1) // several files matched the glob - tell them apart like coreutils
+    {
+      writeOut((i > 0 ? "\n==> " : "==> ") + files[i] + " <==\n");
+    }
+    tailFile(files[i].c_str(), num_lines);
+  }
+}
+
+void TailCommand::tailFile(const char* file_path, int num_lines)
+{
+  int fd = open(file_path, O_RDONLY);
+  if (fd == -1)
+  {
+    perror("smash error: open failed"); 
+    return;
+  }
+
+  int total_lines_counter=0, total_bytes_counter=0;
+  char buf[1], prev_char[1]; //prev char will be used for counting lines 
+  int res = 0;
+  res = read(fd,prev_char,1);
+  if (res == -1)
+  {
+    perror("smash error: read failed");
+    close(fd);
+    return;
+  }
+  ++total_bytes_counter;
+  if (res == 0) // case file is empty (read syscall returned EOF) close file and return
+  {
+    if(close(fd) == -1)
+    {
+      perror("smash error: close failed");
+    }
+    return;
+  }
+  
+  do        //counting num of lines and bytes in given file
+  { 
+    if (isCancelled())
+    {
+      close(fd);
+      return;
+    }
+    res = read(fd, buf, 1);
+    if (res == 1 && (prev_char[0] == '\n') && (buf[0] != EOF)){   //doesnt count empty lines at the end (= count a line only if prev char is '/n' and we havent reached EOF)
+      total_lines_counter++;
+    }  
+    prev_char[0] = buf[0];
+    total_bytes_counter = (res == 1) ? total_bytes_counter + 1 : total_bytes_counter;
+  } while (res == 1);
+
+  if(res == -1)
+  {
+    perror("smash error: read failed");
+    close(fd);
+    return;
+  }
+
+  //moving seek pointer to begenning of file and moving it forward to where it should start reading from
+  lseek(fd, 0, SEEK_SET);
+  char* txt_buf = new char[total_bytes_counter];
+  int unread_bytes =0;
+  if(total_lines_counter < num_lines) //case reading the whole file
+  {
+    if (read(fd,txt_buf,total_bytes_counter) != total_bytes_counter)
+    {
+      perror("smash error: read failed");
+      close(fd);
+      delete[] txt_buf;
+      return;
+    }
+   
+  }
+  else{ //case reading given number of lines
+    int unread_lines_cnt = total_lines_counter - num_lines;
+    do
+    {
+      if (isCancelled())
+      {
+        close(fd);
+        delete[] txt_buf;
+        return;
+      }
+      res = read(fd, buf, 1);
+      if (res == 1 && (buf[0] == '\n')){ 
+        unread_lines_cnt--;
+      }
+      unread_bytes = (res == 1) ? unread_bytes + 1 : unread_bytes;     
+
+    } while(res == 1 && unread_lines_cnt >= 0);
+    if(res == -1)
+    {
+     perror("smash error: read failed");
+     close(fd);
+     delete[] txt_buf;
+     return;
+    }
+  
+    if (read(fd,txt_buf,total_bytes_counter) == -1) 
+    {
+      perror("smash error: read failed");
+      close(fd);
+      delete[] txt_buf;
+    }
+  }
+
+  //here, txt buf has needed info, write it to the screen  
+  if(close(fd) == -1)
+  {
+    perror("smash error: close failed"); 
+    return;
+  }
+
+  if (c_out_fd == STDOUT_FILENO)
+  {
+    std::cout.flush();
+  }
+  if (!_writeAll(c_out_fd, txt_buf, total_bytes_counter - unread_bytes) && errno != EPIPE)
+  {
+    perror("smash error: write failed");
+  }
+  delete[] txt_buf;
+}
+/******************TAIL COMMAND*/
+
+/*TOUCH COMMAND***************/
+TouchCommand::TouchCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
+bool TouchCommand::canRunInBackground() const
+{
+  return true;
+}
+
+bool TouchCommand::canRunInPipe() const
+{
+  return true;
+}
+
+#define TOUCH_BATCH 256 // paths per thread pool item
+
+// parses ss[.fraction]:mm:hh:dd:mm:yyyy into an absolute (nanosecond) time
+static bool _parseTimestamp(const char* str, struct timespec* ts)
+{
+  std::vector<std::string> fields;
+  std::istringstream iss(str);
+  for (std::string field; std::getline(iss, field, ':');)
+  {
+    fields.push_back(field);
+  }
+  if (fields.size() != 6)
+    return false;
+
+  long nsec = 0;
+  size_t dot = fields[0].find('.');
+  if (dot != string::npos)
+  {
+    std::string fraction = fields[0].substr(dot + 1);
+    fields[0] = fields[0].substr(0, dot);
+    if (fraction.empty() || fraction.size() > 9 || fraction.find_first_not_of("0123456789") != string::npos)
+      return false;
+    fraction.resize(9, '0');
+    nsec = atol(fraction.c_str());
+  }
+  for (size_t i = 0; i < fields.size(); i++)
+  {
+    if (fields[i].empty() || fields[i].find_first_not_of("0123456789") != string::npos)
+      return false;
+  }
+
+  struct tm info = {0};
+  info.tm_sec = atoi(fields[0].c_str());
+  info.tm_min = atoi(fields[1].c_str());
+  info.tm_hour = atoi(fields[2].c_str());
+  info.tm_mday = atoi(fields[3].c_str());
+  info.tm_mon = atoi(fields[4].c_str()) - 1;
+  info.tm_year = atoi(fields[5].c_str()) - 1900;
+  time_t ret = mktime(&info);
+  if (ret == -1)
+  {
+    perror("smash error: mktime failed");
+    return false;
+  }
+  ts->tv_sec = ret;
+  ts->tv_nsec = nsec;
+  return true;
+}
+
+// sets the access and modification time of every path to 'time', spread over the thread pool
+// in batches. failures are reported after all the work is done, in the order of the paths, each
+// with perror like a single touch
+static void _touchPaths(const std::vector<std::string>& paths, const struct timespec& time, const Command* cmd)
+{
+  struct timespec times[2] = {time, time};
+  size_t batches = (paths.size() + TOUCH_BATCH - 1) / TOUCH_BATCH;
+  std::vector<std::vector<std::pair<size_t, int> > > errors(batches);
+  std::function<void(size_t)> touch_batch = [&](size_t batch) {
+    size_t end = std::min(paths.size(), (batch + 1) * TOUCH_BATCH);
+    for (size_t i = batch * TOUCH_BATCH; i < end && !cmd->isCancelled(); i++)
+    {
+      if (utimensat(AT_FDCWD, paths[i].c_str(), times, 0) == -1)
+        errors[batch].push_back(std::make_pair(i, errno));
+    }
+  };
+  if (batches == 1)
+  {
+    touch_batch(0);
+  }
+  else
+  {
+    SmallShell::getInstance().getThreadPool()->parallelFor(batches, touch_batch);
+  }
+  for (size_t batch = 0; batch < batches; batch++)
+  {
+    for (size_t k = 0; k < errors[batch].size(); k++)
+    {
+      errno = errors[batch][k].second;
+      perror("smash error: utime failed");
+    }
+  }
+}
+
+// reads a list of paths, NUL separated if there is any NUL in it, one per line otherwise
+static bool _readPathList(int fd, std::vector<std::string>& paths)
+{
+  std::string data;
+  std::vector<char> buf(1 << 16);
+  ssize_t res;
+  while ((res = read(fd, &buf[0], buf.size())) != 0)
+  {
+    if (res == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("smash error: read failed");
+      return false;
+    }
+    data.append(&buf[0], res);
+  }
+  char separator = (data.find('\0') != string::npos) ? '\0' : '\n';
+  size_t start = 0;
+  while (start < data.size())
+  {
+    size_t end = data.find(separator, start);
+    if (end == string::npos)
+      end = data.size();
+    if (end > start)
+      paths.push_back(data.substr(start, end - start));
+    start = end + 1;
+  }
+  return true;
+}
+
+// touch [-f list-file] [file-name/glob ...] <timestamp>
+void TouchCommand::execute()
+{
+  int first_path = 1;
+  const char* list_file = nullptr;
+  if (c_num_of_args > 1 && strcmp(c_args[1], "-f") == 0)
+  {
+    list_file = c_num_of_args > 2 ? c_args[2] : nullptr;
+    first_path = 3;
+  }
+  struct timespec time;
+  if ((list_file == nullptr && c_num_of_args < 3) || (list_file != nullptr && c_num_of_args < 4) ||
+      !_parseTimestamp(c_args[c_num_of_args - 1], &time))
+  {
+    std::cerr << "smash error: touch: invalid arguments" << std::endl;
+    return;
+  }
+
+  std::vector<std::string> paths;
+  if (list_file != nullptr)
+  {
+    int fd = strcmp(list_file, "-") == 0 ? c_in_fd : open(list_file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+      perror("smash error: open failed");
+      return;
+    }
+    bool read_ok = _readPathList(fd, paths);
+    if (fd != c_in_fd)
+      close(fd);
+    if (!read_ok)
+      return;
+  }
+  for (int i = first_path; i < c_num_of_args - 1; i++)
+  {
+    std::vector<std::string> matches = _expandGlob(c_args[i]); // no match - touch the pattern itself
+    paths.insert(paths.end(), matches.begin(), matches.end());
+  }
+  _touchPaths(paths, time, this);
+}
+/******************TOUCH COMMAND*/
+
+/*CAT COMMAND***************/
+#define COPY_CHUNK (8 << 20)     // bytes per kernel copy call - bounds the time to notice a cancel
+#define COPY_BUF_SIZE (256 << 10) // user space fallback buffer
+
+// errors meaning "this copy method does not work for these fds", as opposed to a real I/O error
+static bool _isUnsupportedCopy(int err)
+{
+  return err == EINVAL || err == ENOSYS || err == EXDEV || err == EBADF || err == EOPNOTSUPP || err == ESPIPE;
+}
+
+enum { COPY_DONE, COPY_FAILED, COPY_UNSUPPORTED };
+
+// copies in_fd to out_fd until EOF with the given kernel method, COPY_UNSUPPORTED only
+// when the very first call was refused (nothing was moved yet, so another method can take over)
+static int _kernelCopy(int method, int in_fd, int out_fd, const Command* cmd)
+{
+  bool moved = false;
+  while (!cmd->isCancelled())
+  {
+    ssize_t res;
+    if (method == 0)
+      res = copy_file_range(in_fd, nullptr, out_fd, nullptr, COPY_CHUNK, 0);
+    else if (method == 1)
+      res = sendfile(out_fd, in_fd, nullptr, COPY_CHUNK);
+    else
+      res = splice(in_fd, nullptr, out_fd, nullptr, COPY_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (res == 0)
+      return COPY_DONE;
+    if (res == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      return (!moved && _isUnsupportedCopy(errno)) ? COPY_UNSUPPORTED : COPY_FAILED;
+    }
+    moved = true;
+  }
+  return COPY_DONE;
+}
+
+// copies in_fd to out_fd until EOF, picking the cheapest method the two fds support:
+// copy_file_range (file -> file), sendfile (file -> anything), splice (a pipe on either side)
+// and a large buffer read/write loop as the last resort. perror's and returns false on failure
+static bool _copyFd(int in_fd, int out_fd, const Command* cmd)
+{
+  struct stat in_st, out_st;
+  if (fstat(in_fd, &in_st) == -1 || fstat(out_fd, &out_st) == -1)
+  {
+    perror("smash error: fstat failed");
+    return false;
+  }
+  if (out_fd == STDOUT_FILENO)
+  {
+    std::cout.flush();
+  }
+  bool in_reg = S_ISREG(in_st.st_mode), out_reg = S_ISREG(out_st.st_mode);
+  bool any_pipe = S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode);
+  int methods[3] = {in_reg && out_reg, in_reg, any_pipe};
+  for (int method = 0; method < 3; method++)
+  {
+    if (!methods[method])
+      continue;
+    int res = _kernelCopy(method, in_fd, out_fd, cmd);
+    if (res == COPY_DONE)
+      return true;
+    if (res == COPY_FAILED)
+    {
+      if (errno != EPIPE)
+        perror("smash error: copy failed");
+      return false;
+    }
+  }
+
+  std::vector<char> buf(COPY_BUF_SIZE);
+  while (!cmd->isCancelled())
+  {
+    ssize_t res = read(in_fd, &buf[0], buf.size());
+    if (res == 0)
+      break;
+    if (res == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("smash error: read failed");
+      return false;
+    }
+    if (!_writeAll(out_fd, &buf[0], res))
+    {
+      if (errno != EPIPE)
+        perror("smash error: write failed");
+      return false;
+    }
+  }
+  return true;
+}
+
+CatCommand::CatCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
+bool CatCommand::canRunInBackground() const
+{
+  return true;
+}
+
+bool CatCommand::canRunInPipe() const
+{
+  return true;
+}
+
+void CatCommand::execute()
+{
+  if (c_num_of_args == 1) // no files - copy the input
+  {
+    _copyFd(c_in_fd, c_out_fd, this);
+    return;
+  }
+  std::vector<std::string> files;
+  for (int i = 1; i < c_num_of_args; i++)
+  {
+    std::vector<std::string> matches = _expandGlob(c_args[i]);
+    files.insert(files.end(), matches.begin(), matches.end());
+  }
+  for (size_t i = 0; i < files.size() && !isCancelled(); i++)
+  {
+    if (files[i] == "-")
+    {
+      _copyFd(c_in_fd, c_out_fd, this);
+      continue;
+    }
+    int fd = open(files[i].c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+      perror("smash error: open failed");
+      continue;
+    }
+    bool copied = _copyFd(fd, c_out_fd, this);
+    int copy_errno = errno;
+    if (close(fd) == -1)
+    {
+      perror("smash error: close failed");
+    }
+    if (!copied && copy_errno == EPIPE) // nobody reads the rest
+      break;
+  }
+}
+/******************CAT COMMAND*/
+
+/*TEE COMMAND***************/
+TeeCommand::TeeCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
+bool TeeCommand::canRunInBackground() const
+{
+  return true;
+}
+
+bool TeeCommand::canRunInPipe() const
+{
+  return true;
+}
+
+// reads exactly len bytes (the data is known to be there, e.g. in one of our pipes)
+static bool _readAll(int fd, char* buf, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t res = read(fd, buf, len);
+    if (res == -1 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return false;
+    buf += res;
+    len -= res;
+  }
+  return true;
+}
+
+// splices exactly len bytes out of pipe_fd, *moved tells how far it got on failure
+static bool _spliceAll(int pipe_fd, int out_fd, size_t len, size_t* moved)
+{
+  *moved = 0;
+  while (*moved < len)
+  {
+    ssize_t res = splice(pipe_fd, nullptr, out_fd, nullptr, len - *moved, SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (res == -1 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return false;
+    *moved += res;
+  }
+  return true;
+}
+
+bool TeeCommand::writeTarget(TeeTarget& target, const char* buf, size_t len)
+{
+  if (target.fd == STDOUT_FILENO)
+  {
+    std::cout.flush();
+  }
+  if (!_writeAll(target.fd, buf, len))
+  {
+    if (errno != EPIPE)
+      perror("smash error: write failed");
+    target.failed = true;
+    return false;
+  }
+  return true;
+}
+
+void TeeCommand::teeBuffered(std::vector<TeeTarget>& targets)
+{
+  std::vector<char> buf(COPY_BUF_SIZE);
+  size_t alive = targets.size();
+  while (alive > 0 && !isCancelled())
+  {
+    ssize_t len = read(c_in_fd, &buf[0], buf.size());
+    if (len == -1 && errno == EINTR)
+      continue;
+    if (len == -1)
+      perror("smash error: read failed");
+    if (len <= 0)
+      return;
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+      if (!targets[i].failed && !writeTarget(targets[i], &buf[0], len))
+        alive--;
+    }
+  }
+}
+
+// every chunk is first spliced from the input into our own pipe 'chunk'. each target except
+// the last one gets a tee(2) copy of it through the 'copy' pipe, and the last one consumes it.
+// a target refusing splice (tty, O_APPEND file on old kernels...) is written from a user space
+// copy from then on - nothing is consumed when splice refuses, so no data is lost on the switch
+void TeeCommand::teeFromPipe(std::vector<TeeTarget>& targets)
+{
+  int chunk[2], copy[2];
+  if (pipe2(chunk, O_CLOEXEC) == -1 || pipe2(copy, O_CLOEXEC) == -1)
+  {
+    perror("smash error: pipe failed");
+    return;
+  }
+  // make both pipes as large as the input one so a whole chunk always fits in a single tee
+  int in_size = fcntl(c_in_fd, F_GETPIPE_SZ);
+  if (in_size > 0)
+  {
+    fcntl(chunk[1], F_SETPIPE_SZ, in_size);
+    fcntl(copy[1], F_SETPIPE_SZ, in_size);
+  }
+  size_t chunk_size = std::min(fcntl(chunk[1], F_GETPIPE_SZ), fcntl(copy[1], F_GETPIPE_SZ));
+  std::vector<char> buf(chunk_size);
+
+  size_t alive = targets.size();
+  while (alive > 0 && !isCancelled())
+  {
+    ssize_t len = splice(c_in_fd, nullptr, chunk[1], nullptr, chunk_size, SPLICE_F_MOVE);
+    if (len == -1 && errno == EINTR)
+      continue;
+    if (len == -1)
+      perror("smash error: splice failed");
+    if (len <= 0)
+      break;
+
+    std::vector<size_t> buffered; // targets to write from user space in this chunk
+    int consumer = -1;            // the target splicing the chunk itself, if any
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+      if (targets[i].failed)
+        continue;
+      if (!targets[i].use_splice)
+        buffered.push_back(i);
+      else
+        consumer = i;
+    }
+    if (!buffered.empty())
+      consumer = -1; // the chunk must stay in the pipe until it is read for the buffered targets
+
+    bool io_error = false;
+    for (size_t i = 0; i < targets.size() && !io_error; i++)
+    {
+      if (targets[i].failed || !targets[i].use_splice || (int)i == consumer)
+        continue;
+      ssize_t copied = tee(chunk[0], copy[1], len, 0);
+      if (copied == -1)
+      {
+        if (!_isUnsupportedCopy(errno))
+        {
+          perror("smash error: tee failed");
+          io_error = true;
+          break;
+        }
+        targets[i].use_splice = false;
+        buffered.push_back(i);
+        continue;
+      }
+      size_t moved = 0;
+      if (copied == len && _spliceAll(copy[0], targets[i].fd, len, &moved))
+        continue;
+      int err = errno;
+      if ((size_t)copied > moved && !_readAll(copy[0], &buf[0], copied - moved)) // empty 'copy' for the next target
+      {
+        perror("smash error: read failed");
+        io_error = true;
+        break;
+      }
+      if (copied != len || (moved == 0 && _isUnsupportedCopy(err))) // short tee / splice refused the fd
+      {
+        targets[i].use_splice = (copied != len);
+        buffered.push_back(i);
+        continue;
+      }
+      if (err != EPIPE)
+        perror("smash error: splice failed");
+      targets[i].failed = true;
+      alive--;
+    }
+    if (io_error)
+      break;
+    if (!buffered.empty() && consumer != -1) // a target fell back above: the chunk is read for it
+    {
+      buffered.push_back(consumer);
+      consumer = -1;
+    }
+
+    if (consumer != -1)
+    {
+      size_t moved = 0;
+      if (_spliceAll(chunk[0], targets[consumer].fd, len, &moved))
+        continue;
+      int err = errno;
+      if (moved > 0 || !_isUnsupportedCopy(err))
+      {
+        if (err != EPIPE)
+          perror("smash error: splice failed");
+        targets[consumer].failed = true;
+        alive--;
+        if (!_readAll(chunk[0], &buf[0], len - moved)) // drop the rest of the chunk
+          break;
+        continue;
+      }
+      targets[consumer].use_splice = false;
+      buffered.push_back(consumer);
+    }
+    if (!_readAll(chunk[0], &buf[0], len))
+    {
+      perror("smash error: read failed");
+      break;
+    }
+    for (size_t k = 0; k < buffered.size(); k++)
+    {
+      if (!writeTarget(targets[buffered[k]], &buf[0], len))
+        alive--;
+    }
+  }
+  close(chunk[0]);
+  close(chunk[1]);
+  close(copy[0]);
+  close(copy[1]);
+}
+
+void TeeCommand::execute()
+{
+  bool append = false;
+  int first_file = 1;
+  if (c_num_of_args > 1 && strcmp(c_args[1], "-a") == 0)
+  {
+    append = true;
+    first_file = 2;
+  }
+
+  std::vector<TeeTarget> targets;
+  TeeTarget out = {c_out_fd, true, false};
+  targets.push_back(out);
+  for (int i = first_file; i < c_num_of_args; i++)
+  {
+    int flags = O_CREAT | O_WRONLY | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+    int fd = open(c_args[i], flags, 0655);
+    if (fd == -1)
+    {
+      perror("smash error: open failed");
+      continue;
+    }
+    TeeTarget target = {fd, true, false};
+    targets.push_back(target);
+  }
+
+  struct stat in_st;
+  if (fstat(c_in_fd, &in_st) == -1)
+  {
+    perror("smash error: fstat failed");
+  }
+  else if (S_ISFIFO(in_st.st_mode))
+  {
+    teeFromPipe(targets);
+  }
+  else
+  {
+    teeBuffered(targets);
+  }
+
+  for (size_t i = 1; i < targets.size(); i++)
+  {
+    if (close(targets[i].fd) == -1)
+    {
+      perror("smash error: close failed");
+    }
+  }
+}
+/******************TEE COMMAND*/
+
+/*WC COMMAND***************/
+#define WC_SHARD_SIZE (4 << 20) // bytes of a regular file counted by one thread pool item
+#define WC_BUF_SIZE (256 << 10) // read size inside a shard / from a stream
+
+// what the kernels count over one piece of data. in_word carries "the last byte was not a
+// space" from one piece to the next, so a word crossing the boundary is counted once
+typedef void (*WcKernel)(const unsigned char* data, size_t len, bool words, bool* in_word,
+                         unsigned long long* lines, unsigned long long* word_count);
+
+// isspace() of the C locale: ' ', \t, \n, \v, \f, \r
+static inline bool _wcIsSpace(unsigned char c)
+{
+  return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+// like coreutils in the C locale a word is a run of printable non-space bytes. the other
+// (non printable) bytes neither start nor end a word
+static inline bool _wcIsWordChar(unsigned char c)
+{
+  return c > ' ' && c < 0x7f;
+}
+
+static void _wcScalar(const unsigned char* data, size_t len, bool words, bool* in_word,
+                      unsigned long long* lines, unsigned long long* word_count)
+{
+  unsigned long long found_lines = 0, found_words = 0;
+  bool inside = *in_word;
+  for (size_t i = 0; i < len; i++)
+  {
+    found_lines += (data[i] == '\n');
+    if (words && _wcIsSpace(data[i]))
+    {
+      inside = false;
+    }
+    else if (words && _wcIsWordChar(data[i]))
+    {
+      found_words += !inside;
+      inside = true;
+    }
+  }
+  *lines += found_lines;
+  *word_count += found_words;
+  *in_word = inside;
+}
+
+#ifdef __x86_64__
+// 16 bytes per step. newlines only: the compare results are summed per byte lane and folded
+// with psadbw every 255 steps. with words: a word starts at every word byte whose previous
+// byte (shifted in from the last step for bit 0) is a space. the rare steps holding non
+// printable bytes are left to _wcScalar
+static void _wcSse2(const unsigned char* data, size_t len, bool words, bool* in_word,
+                    unsigned long long* lines, unsigned long long* word_count)
+{
+  const __m128i newline = _mm_set1_epi8('\n'), blank = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t'), ctl_range = _mm_set1_epi8('\r' - '\t');
+  const __m128i word_first = _mm_set1_epi8('!'), word_range = _mm_set1_epi8('~' - '!');
+  unsigned long long found_lines = 0, found_words = 0;
+  size_t i = 0;
+  if (!words)
+  {
+    while (i + 16 <= len)
+    {
+      __m128i acc = _mm_setzero_si128();
+      for (int step = 0; step < 255 && i + 16 <= len; step++, i += 16)
+      {
+        __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+        acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(block, newline));
+      }
+      __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+      found_lines += _mm_extract_epi16(sums, 0) + _mm_extract_epi16(sums, 4);
+    }
+  }
+  else
+  {
+    unsigned prev_space = *in_word ? 0 : 1;
+    for (; i + 16 <= len; i += 16)
+    {
+      __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+      __m128i ctl = _mm_sub_epi8(block, tab), word = _mm_sub_epi8(block, word_first);
+      __m128i space = _mm_or_si128(_mm_cmpeq_epi8(block, blank), _mm_cmpeq_epi8(_mm_min_epu8(ctl, ctl_range), ctl));
+      unsigned mask = _mm_movemask_epi8(space);
+      if ((mask | _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(word, word_range), word))) != 0xFFFF)
+      {
+        bool inside = !prev_space;
+        _wcScalar(data + i, 16, words, &inside, &found_lines, &found_words);
+        prev_space = !inside;
+        continue;
+      }
+      found_lines += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+      found_words += __builtin_popcount(~mask & ((mask << 1) | prev_space) & 0xFFFF);
+      prev_space = mask >> 15;
+    }
+    *in_word = !prev_space;
+  }
+  *lines += found_lines;
+  *word_count += found_words;
+  _wcScalar(data + i, len - i, words, in_word, lines, word_count);
+}
+
+// the same as _wcSse2, 32 bytes per step. only used when the cpu has AVX2
+__attribute__((target("avx2,popcnt")))
+static void _wcAvx2(const unsigned char* data, size_t len, bool words, bool* in_word,
+                    unsigned long long* lines, unsigned long long* word_count)
+{
+  const __m256i newline = _mm256_set1_epi8('\n'), blank = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t'), ctl_range = _mm256_set1_epi8('\r' - '\t');
+  const __m256i word_first = _mm256_set1_epi8('!'), word_range = _mm256_set1_epi8('~' - '!');
+  unsigned long long found_lines = 0, found_words = 0;
+  size_t i = 0;
+  if (!words)
+  {
+    while (i + 32 <= len)
+    {
+      __m256i acc = _mm256_setzero_si256();
+      for (int step = 0; step < 255 && i + 32 <= len; step++, i += 32)
+      {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(data + i));
+        acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(block, newline));
+      }
+      __m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+      found_lines += _mm256_extract_epi16(sums, 0) + _mm256_extract_epi16(sums, 4) +
+                     _mm256_extract_epi16(sums, 8) + _mm256_extract_epi16(sums, 12);
+    }
+  }
+  else
+  {
+    unsigned prev_space = *in_word ? 0 : 1;
+    for (; i + 32 <= len; i += 32)
+    {
+      __m256i block = _mm256_loadu_si256((const __m256i*)(data + i));
+      __m256i ctl = _mm256_sub_epi8(block, tab), word = _mm256_sub_epi8(block, word_first);
+      __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(block, blank),
+                                      _mm256_cmpeq_epi8(_mm256_min_epu8(ctl, ctl_range), ctl));
+      unsigned mask = _mm256_movemask_epi8(space);
+      if ((mask | (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(word, word_range), word))) != 0xFFFFFFFFu)
+      {
+        bool inside = !prev_space;
+        _wcScalar(data + i, 32, words, &inside, &found_lines, &found_words);
+        prev_space = !inside;
+        continue;
+      }
+      found_lines += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)));
+      found_words += __builtin_popcount(~mask & ((mask << 1) | prev_space));
+      prev_space = mask >> 31;
+    }
+    *in_word = !prev_space;
+  }
+  *lines += found_lines;
+  *word_count += found_words;
+  _wcScalar(data + i, len - i, words, in_word, lines, word_count);
+}
+#endif
+
+// the fastest kernel this cpu runs, picked once
+static WcKernel _wcKernel()
+{
+#ifdef __x86_64__
+  static const WcKernel kernel = __builtin_cpu_supports("avx2") ? _wcAvx2 : _wcSse2;
+  return kernel;
+#else
+  return _wcScalar;
+#endif
+}
+
+// the counts of one shard. each shard starts outside a word, so a word crossing into the next
+// shard is counted by both - the merge subtracts it when the shard ended inside a word and the
+// next one continued it (its first word byte came before any space)
+struct WcShard
+{
+  unsigned long long lines;
+  unsigned long long words;
+  bool starts_in_word;
+  bool ends_in_word;
+  bool has_edge; // false when the shard holds no space or word byte at all
+  int error; // errno of a failed pread, 0 otherwise
+};
+
+WcCommand::WcCommand(const char *cmd_line) : BuiltInCommand(cmd_line), count_lines(false), count_words(false), count_bytes(false) {}
+bool WcCommand::canRunInBackground() const
+{
+  return true;
+}
+
+bool WcCommand::canRunInPipe() const
+{
+  return true;
+}
+
+// a regular file with a known size: bytes come from fstat, and lines / words are counted from
+// the current offset in WC_SHARD_SIZE shards spread over the thread pool, read with pread
+bool WcCommand::countFile(int fd, WcCounts& counts)
+{
+  struct stat st;
+  off_t offset = lseek(fd, 0, SEEK_CUR);
+  if (fstat(fd, &st) == -1 || offset == -1)
+  {
+    perror("smash error: fstat failed");
+    return false;
+  }
+  size_t len = offset < st.st_size ? st.st_size - offset : 0;
+  counts.bytes = len;
+  if ((count_lines || count_words) && len > 0)
+  {
+    WcKernel kernel = _wcKernel();
+    size_t shards = (len + WC_SHARD_SIZE - 1) / WC_SHARD_SIZE;
+    std::vector<WcShard> results(shards);
+    std::function<void(size_t)> count_shard = [&](size_t shard) {
+      WcShard& result = results[shard];
+      result.lines = result.words = 0;
+      result.starts_in_word = result.ends_in_word = result.has_edge = false;
+      result.error = 0;
+      std::vector<unsigned char> buf(std::min<size_t>(WC_BUF_SIZE, len));
+      size_t pos = shard * (size_t)WC_SHARD_SIZE, end = std::min(len, pos + WC_SHARD_SIZE);
+      bool in_word = false;
+      while (pos < end && !isCancelled())
+      {
+        ssize_t res = pread(fd, &buf[0], std::min(buf.size(), end - pos), offset + pos);
+        if (res == -1 && errno == EINTR)
+          continue;
+        if (res <= 0) // 0: the file was truncated under us
+        {
+          result.error = res == 0 ? 0 : errno;
+          break;
+        }
+        for (ssize_t k = 0; k < res && !result.has_edge; k++)
+        {
+          result.has_edge = _wcIsSpace(buf[k]) || _wcIsWordChar(buf[k]);
+          result.starts_in_word = _wcIsWordChar(buf[k]);
+        }
+        kernel(&buf[0], res, count_words, &in_word, &result.lines, &result.words);
+        pos += res;
+      }
+      result.ends_in_word = in_word;
+    };
+    if (shards == 1)
+    {
+      count_shard(0);
+    }
+    else
+    {
+      SmallShell::getInstance().getThreadPool()->parallelFor(shards, count_shard);
+    }
+    bool in_word = false;
+    for (size_t shard = 0; shard < shards; shard++)
+    {
+      if (results[shard].error != 0)
+      {
+        errno = results[shard].error;
+        perror("smash error: read failed");
+        return false;
+      }
+      counts.lines += results[shard].lines;
+      counts.words += results[shard].words;
+      if (in_word && results[shard].starts_in_word)
+        counts.words--;
+      if (results[shard].has_edge)
+        in_word = results[shard].ends_in_word;
+    }
+  }
+  if (lseek(fd, st.st_size, SEEK_SET) == -1) // consume the input like a read would
+  {
+    perror("smash error: lseek failed");
+  }
+  return !isCancelled();
+}
+
+// anything without a usable size (pipes, terminals, /proc files): one sequential pass
+bool WcCommand::countStream(int fd, WcCounts& counts)
+{
+  WcKernel kernel = _wcKernel();
+  std::vector<unsigned char> buf(WC_BUF_SIZE);
+  bool in_word = false;
+  while (!isCancelled())
+  {
+    ssize_t res = read(fd, &buf[0], buf.size());
+    if (res == 0)
+      return true;
+    if (res == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("smash error: read failed");
+      return false;
+    }
+    counts.bytes += res;
+    if (count_lines || count_words)
+      kernel(&buf[0], res, count_words, &in_word, &counts.lines, &counts.words);
+  }
+  return false;
+}
+
+std::string WcCommand::formatCounts(const WcCounts& counts, int width, const std::string& name) const
+{
+  std::ostringstream line;
+  const char* separator = "";
+  if (count_lines)
+  {
+    line << std::setw(width) << counts.lines;
+    separator = " ";
+  }
+  if (count_words)
+  {
+    line << separator << std::setw(width) << counts.words;
+    separator = " ";
+  }
+  if (count_bytes)
+  {
+    line << separator << std::setw(width) << counts.bytes;
+  }
+  if (!name.empty())
+  {
+    line << " " << name;
+  }
+  line << std::endl;
+  return line.str();
+}
+
+// wc [-l] [-w] [-c] [file-name/glob ...] - no option means all three, no file (or "-") the input
+void WcCommand::execute()
+{
+  int first_file = 1;
+  for (; first_file < c_num_of_args && c_args[first_file][0] == '-' && c_args[first_file][1] != '\0'; first_file++)
+  {
+    for (const char* option = c_args[first_file] + 1; *option != '\0'; option++)
+    {
+      if (*option == 'l')
+        count_lines = true;
+      else if (*option == 'w')
+        count_words = true;
+      else if (*option == 'c')
+        count_bytes = true;
+      else
+      {
+        std::cerr << "smash error: wc: invalid arguments" << std::endl;
+        return;
+      }
+    }
+  }
+  if (!count_lines && !count_words && !count_bytes)
+  {
+    count_lines = count_words = count_bytes = true;
+  }
+
+  std::vector<std::string> files;
+  for (int i = first_file; i < c_num_of_args; i++)
+  {
+    std::vector<std::string> matches = _expandGlob(c_args[i]);
+    files.insert(files.end(), matches.begin(), matches.end());
+  }
+  bool named = !files.empty();
+  if (!named)
+  {
+    files.push_back("-");
+  }
+
+  std::vector<WcCounts> results;
+  std::vector<std::string> names;
+  WcCounts total = {0, 0, 0};
+  unsigned long long total_size = 0;
+  bool any_stream = false;
+  for (size_t i = 0; i < files.size() && !isCancelled(); i++)
+  {
+    bool is_input = files[i] == "-";
+    int fd = is_input ? c_in_fd : open(files[i].c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+      perror("smash error: open failed");
+      continue;
+    }
+    WcCounts counts = {0, 0, 0};
+    struct stat st;
+    bool counted;
+    bool is_file = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    if (is_file)
+      total_size += st.st_size;
+    else
+      any_stream = true;
+    counted = (is_file && st.st_size > 0) ? countFile(fd, counts) : countStream(fd, counts);
+    if (!is_input && close(fd) == -1)
+    {
+      perror("smash error: close failed");
+    }
+    if (!counted)
+      continue;
+    results.push_back(counts);
+    names.push_back(named ? files[i] : "");
+    total.lines += counts.lines;
+    total.words += counts.words;
+    total.bytes += counts.bytes;
+  }
+  if (isCancelled())
+    return;
+
+  // like coreutils: columns as wide as the total size, at least 7 for streams, no padding
+  // for a single number
+  int width = 1;
+  if (count_lines + count_words + count_bytes > 1 || files.size() > 1)
+  {
+    width = std::to_string(total_size).size();
+    if (any_stream)
+      width = std::max(width, 7);
+  }
+  std::string out;
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    out += formatCounts(results[i], width, names[i]);
+  }
+  if (files.size() > 1)
+  {
+    out += formatCounts(total, width, "total");
+  }
+  writeOut(out);
+}
+/******************WC COMMAND*/
+
+/*SEARCH COMMAND***************/
+#define SEARCH_SHARD_SIZE (4 << 20)  // bytes of a mapped file searched by one thread pool item
+#define SEARCH_BUF_SIZE (256 << 10)  // read size of a stream
+#define SEARCH_OUT_FLUSH (1 << 20)   // buffered output is written once it grows this big
+
+// the longest run of characters every match of the extended regex contains, "" when there is
+// none that is safe to require (top level alternation, only classes / optional characters).
+// anything inside a group is skipped, the group may be optional or hold an alternation
+static std::string _requiredLiteral(const std::string& ere)
+{
+  std::string best, run;
+  int depth = 0;
+  size_t i = 0;
+  while (i < ere.size())
+  {
+    char c = ere[i];
+    std::string atom; // the character this element matches, empty if it is not a literal
+    size_t next = i + 1;
+    if (c == '[') // bracket expression - up to its closing ']'
+    {
+      size_t j = i + 1;
+      if (j < ere.size() && ere[j] == '^')
+        j++;
+      if (j < ere.size() && ere[j] == ']')
+        j++;
+      while (j < ere.size() && ere[j] != ']')
+      {
+        if (ere[j] == '[' && j + 1 < ere.size() && strchr(":.=", ere[j + 1]) != nullptr)
+        {
+          size_t close = ere.find(std::string(1, ere[j + 1]) + "]", j + 2); // [:alpha:] etc.
+          j = (close == string::npos) ? ere.size() : close + 2;
+        }
+        else
+        {
+          j++;
+        }
+      }
+      next = j + 1;
+    }
+    else if (c == '{') // interval of the previous element
+    {
+      size_t close = ere.find('}', i);
+      next = (close == string::npos) ? ere.size() : close + 1;
+    }
+    else if (c == '\\' && i + 1 < ere.size())
+    {
+      next = i + 2;
+      if (!isalnum((unsigned char)ere[i + 1])) // \. \* ... (\w, \b, \1 are not literals)
+        atom = ere[i + 1];
+    }
+    else if (c == '(')
+      depth++;
+    else if (c == ')')
+      depth--;
+    else if (c == '|' && depth == 0)
+      return "";
+    else if (strchr(".^$*+?|", c) == nullptr)
+      atom = c;
+
+    bool optional = next < ere.size() && strchr("*?{", ere[next]) != nullptr;
+    if (!atom.empty() && depth == 0 && !optional)
+    {
+      run += atom;
+    }
+    else
+    {
+      if (run.size() > best.size())
+        best = run;
+      run.clear();
+    }
+    i = next;
+  }
+  return run.size() > best.size() ? run : best;
+}
+
+static bool _isFixedPattern(const std::string& pattern)
+{
+  return pattern.find_first_of(".[]()^$*+?{}|\\") == string::npos;
+}
+
+// the first occurrence of needle in hay (n > 0). 16 candidate positions at a time are picked by
+// comparing the first and the last character of the needle (both cases when ignoring case),
+// and only the candidates are compared in full
+static const char* _findLiteral(const char* hay, size_t len, const std::string& needle, bool ignore_case)
+{
+  size_t n = needle.size();
+  if (n > len)
+    return nullptr;
+  size_t i = 0;
+#ifdef __x86_64__
+  char first_char = needle[0], last_char = needle[n - 1];
+  const __m128i first_lower = _mm_set1_epi8(ignore_case ? tolower(first_char) : first_char);
+  const __m128i first_upper = _mm_set1_epi8(ignore_case ? toupper(first_char) : first_char);
+  const __m128i last_lower = _mm_set1_epi8(ignore_case ? tolower(last_char) : last_char);
+  const __m128i last_upper = _mm_set1_epi8(ignore_case ? toupper(last_char) : last_char);
+  for (; i + n - 1 + 16 <= len; i += 16)
+  {
+    __m128i first = _mm_loadu_si128((const __m128i*)(hay + i));
+    __m128i last = _mm_loadu_si128((const __m128i*)(hay + i + n - 1));
+    __m128i candidates = _mm_and_si128(_mm_or_si128(_mm_cmpeq_epi8(first, first_lower), _mm_cmpeq_epi8(first, first_upper)),
+                                       _mm_or_si128(_mm_cmpeq_epi8(last, last_lower), _mm_cmpeq_epi8(last, last_upper)));
+    for (unsigned mask = _mm_movemask_epi8(candidates); mask != 0; mask &= mask - 1)
+    {
+      size_t at = i + __builtin_ctz(mask);
+      if ((ignore_case ? strncasecmp(hay + at, needle.c_str(), n) : memcmp(hay + at, needle.data(), n)) == 0)
+        return hay + at;
+    }
+  }
+#endif
+  if (!ignore_case)
+    return (const char*)memmem(hay + i, len - i, needle.data(), n);
+  for (; i + n <= len; i++)
+  {
+    if (strncasecmp(hay + i, needle.c_str(), n) == 0)
+      return hay + i;
+  }
+  return nullptr;
+}
+
+SearchCommand::SearchCommand(const char *cmd_line) : BuiltInCommand(cmd_line), ignore_case(false), line_numbers(false), fixed(false) {}
+bool SearchCommand::canRunInBackground() const
+{
+  return true;
+}
+
+bool SearchCommand::canRunInPipe() const
+{
+  return true;
+}
+
+// finds the matching lines of data[0, len). with a literal only the lines holding it are
+// looked at at all. newlines gets the number of '\n' in the range when line numbers are on
+void SearchCommand::searchRange(const char* data, size_t len, const regex_t* regex,
+                                std::vector<SearchMatch>& matches, unsigned long long& newlines) const
+{
+  WcKernel count_newlines = _wcKernel();
+  unsigned long long line = 0, no_words = 0;
+  bool no_word = false;
+  size_t counted = 0; // the newlines of data[0, counted) are in line
+  size_t pos = 0;
+  while (pos < len && !isCancelled())
+  {
+    size_t start = pos;
+    if (!literal.empty())
+    {
+      const char* hit = _findLiteral(data + pos, len - pos, literal, ignore_case);
+      if (hit == nullptr)
+        break;
+      const char* prev_newline = (const char*)memrchr(data + pos, '\n', hit - (data + pos));
+      start = (prev_newline == nullptr) ? pos : prev_newline - data + 1;
+    }
+    const char* newline = (const char*)memchr(data + start, '\n', len - start);
+    size_t end = (newline == nullptr) ? len : newline - data;
+    bool matched = fixed;
+    if (!matched)
+    {
+      regmatch_t range;
+      range.rm_so = 0;
+      range.rm_eo = end - start;
+      matched = regexec(regex, data + start, 1, &range, REG_STARTEND) == 0;
+    }
+    if (matched)
+    {
+      if (line_numbers)
+      {
+        count_newlines((const unsigned char*)data + counted, start - counted, false, &no_word, &line, &no_words);
+        counted = start;
+      }
+      SearchMatch match = {line, start, end};
+      matches.push_back(match);
+    }
+    pos = end + 1;
+  }
+  if (line_numbers)
+  {
+    count_newlines((const unsigned char*)data + counted, len - counted, false, &no_word, &line, &no_words);
+  }
+  newlines = line;
+}
+
+void SearchCommand::appendMatches(std::string& out, const char* data, const std::vector<SearchMatch>& matches,
+                                  unsigned long long first_line, const std::string& prefix) const
+{
+  for (size_t i = 0; i < matches.size(); i++)
+  {
+    out += prefix;
+    if (line_numbers)
+    {
+      out += std::to_string(first_line + matches[i].line);
+      out += ':';
+    }
+    out.append(data + matches[i].start, matches[i].end - matches[i].start);
+    out += '\n';
+  }
+}
+
+// pipes, terminals and files without a size: searched as the complete lines arrive, the
+// output is written after every read so a pipeline keeps flowing
+bool SearchCommand::searchStream(int fd, const std::string& prefix, const regex_t* regex)
+{
+  std::vector<char> buf(SEARCH_BUF_SIZE);
+  std::string pending, out;
+  unsigned long long first_line = 1;
+  while (!isCancelled())
+  {
+    ssize_t res = read(fd, &buf[0], buf.size());
+    if (res == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("smash error: read failed");
+      return false;
+    }
+    pending.append(&buf[0], res);
+    size_t last_newline = pending.rfind('\n');
+    size_t usable = (res == 0) ? pending.size() : (last_newline == string::npos ? 0 : last_newline + 1);
+    if (usable > 0)
+    {
+      std::vector<SearchMatch> matches;
+      unsigned long long newlines;
+      searchRange(pending.data(), usable, regex, matches, newlines);
+      appendMatches(out, pending.data(), matches, first_line, prefix);
+      first_line += newlines;
+      pending.erase(0, usable);
+      if (!out.empty() && !writeOut(out))
+        return false;
+      out.clear();
+    }
+    if (res == 0)
+      return true;
+  }
+  return false;
+}
+
+// search [-i] [-n] [-F] pattern [file-name/glob ...] - no file (or "-") searches the input
+void SearchCommand::execute()
+{
+  int arg = 1;
+  for (; arg < c_num_of_args && c_args[arg][0] == '-' && c_args[arg][1] != '\0'; arg++)
+  {
+    for (const char* option = c_args[arg] + 1; *option != '\0'; option++)
+    {
+      if (*option == 'i')
+        ignore_case = true;
+      else if (*option == 'n')
+        line_numbers = true;
+      else if (*option == 'F')
+        fixed = true;
+      else
+      {
+        std::cerr << "smash error: search: invalid arguments" << std::endl;
+        return;
+      }
+    }
+  }
+  if (arg >= c_num_of_args)
+  {
+    std::cerr << "smash error: search: invalid arguments" << std::endl;
+    return;
+  }
+  pattern = c_args[arg++];
+  fixed = fixed || _isFixedPattern(pattern);
+  literal = fixed ? pattern : _requiredLiteral(pattern);
+
+  // glibc serializes regexec calls on one regex_t, so every worker borrows its own copy
+  std::vector<regex_t*> regexes, free_regexes;
+  std::mutex regexes_lock;
+  int regex_flags = REG_EXTENDED | REG_NOSUB | (ignore_case ? REG_ICASE : 0);
+  regex_t* main_regex = nullptr;
+  if (!fixed)
+  {
+    main_regex = new regex_t;
+    int err = regcomp(main_regex, pattern.c_str(), regex_flags);
+    if (err != 0)
+    {
+      char msg[256];
+      regerror(err, main_regex, msg, sizeof(msg));
+      std::cerr << "smash error: search: invalid pattern: " << msg << std::endl;
+      delete main_regex;
+      return;
+    }
+    regexes.push_back(main_regex);
+  }
+  std::function<regex_t*()> borrow_regex = [&]() -> regex_t* {
+    if (fixed)
+      return nullptr;
+    std::lock_guard<std::mutex> guard(regexes_lock);
+    if (!free_regexes.empty())
+    {
+      regex_t* regex = free_regexes.back();
+      free_regexes.pop_back();
+      return regex;
+    }
+    regex_t* regex = new regex_t;
+    regcomp(regex, pattern.c_str(), regex_flags); // compiled fine once already
+    regexes.push_back(regex);
+    return regex;
+  };
+  std::function<void(regex_t*)> return_regex = [&](regex_t* regex) {
+    if (regex == nullptr)
+      return;
+    std::lock_guard<std::mutex> guard(regexes_lock);
+    free_regexes.push_back(regex);
+  };
+
+  struct SearchFile
+  {
+    std::string name;
+    int fd;          // open for streams, -1 otherwise
+    int open_errno;  // reported at the file's turn in the output
+    const char* data; // mapped files
+    size_t len;
+  };
+  struct SearchUnit
+  {
+    size_t file;
+    size_t begin;
+    size_t end;
+    std::vector<SearchMatch> matches;
+    unsigned long long newlines;
+  };
+  std::vector<std::string> names;
+  for (; arg < c_num_of_args; arg++)
+  {
+    std::vector<std::string> matches = _expandGlob(c_args[arg]);
+    names.insert(names.end(), matches.begin(), matches.end());
+  }
+  if (names.empty())
+  {
+    names.push_back("-");
+  }
+  bool with_names = names.size() > 1;
+
+  std::vector<SearchFile> files(names.size());
+  std::vector<SearchUnit> units;
+  for (size_t i = 0; i < names.size(); i++)
+  {
+    SearchFile& file = files[i];
+    file.name = names[i];
+    file.fd = -1;
+    file.open_errno = 0;
+    file.data = nullptr;
+    file.len = 0;
+    int fd = (file.name == "-") ? fcntl(c_in_fd, F_DUPFD_CLOEXEC, 0) : open(file.name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+      file.open_errno = errno;
+      continue;
+    }
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+      map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (map == MAP_FAILED)
+    {
+      file.fd = fd;
+      continue;
+    }
+    close(fd);
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    file.data = (const char*)map;
+    file.len = st.st_size;
+    // shard k holds the lines starting in [k * SEARCH_SHARD_SIZE, (k + 1) * SEARCH_SHARD_SIZE)
+    size_t begin = 0;
+    while (begin < file.len)
+    {
+      size_t end = file.len;
+      if (begin + SEARCH_SHARD_SIZE < file.len)
+      {
+        const char* newline = (const char*)memchr(file.data + begin + SEARCH_SHARD_SIZE - 1, '\n',
+                                                  file.len - (begin + SEARCH_SHARD_SIZE - 1));
+        end = (newline == nullptr) ? file.len : newline - file.data + 1;
+      }
+      SearchUnit unit;
+      unit.file = i;
+      unit.begin = begin;
+      unit.end = end;
+      unit.newlines = 0;
+      units.push_back(unit);
+      begin = end;
+    }
+  }
+
+  // units are searched in batches on the pool and printed in order after each batch, so the
+  // matches kept in memory stay bounded
+  ThreadPool* pool = SmallShell::getInstance().getThreadPool();
+  size_t batch_size = 2 * (pool->size() + 1);
+  std::function<void(size_t)> search_unit = [&](size_t u) {
+    SearchUnit& unit = units[u];
+    regex_t* regex = borrow_regex();
+    searchRange(files[unit.file].data + unit.begin, unit.end - unit.begin, regex, unit.matches, unit.newlines);
+    return_regex(regex);
+  };
+  std::string out;
+  bool output_ok = true;
+  size_t next_unit = 0;
+  unsigned long long first_line = 1;
+  for (size_t i = 0; i < files.size() && output_ok && !isCancelled(); i++)
+  {
+    SearchFile& file = files[i];
+    std::string prefix = with_names ? file.name + ":" : "";
+    if (file.open_errno != 0)
+    {
+      output_ok = (out.empty() || writeOut(out));
+      out.clear();
+      errno = file.open_errno;
+      perror("smash error: open failed");
+      continue;
+    }
+    if (file.fd != -1)
+    {
+      output_ok = (out.empty() || writeOut(out)) && searchStream(file.fd, prefix, main_regex);
+      out.clear();
+      continue;
+    }
+    first_line = 1;
+    for (; next_unit < units.size() && units[next_unit].file == i && output_ok && !isCancelled(); next_unit++)
+    {
+      if (next_unit % batch_size == 0) // search the next batch (running ahead into the next files)
+      {
+        size_t count = std::min(batch_size, units.size() - next_unit);
+        size_t first = next_unit;
+        pool->parallelFor(count, [&](size_t k) { search_unit(first + k); });
+      }
+      SearchUnit& unit = units[next_unit];
+      appendMatches(out, file.data + unit.begin, unit.matches, first_line, prefix);
+      first_line += unit.newlines;
+      std::vector<SearchMatch>().swap(unit.matches);
+      if (out.size() >= SEARCH_OUT_FLUSH)
+      {
+        output_ok = writeOut(out);
+        out.clear();
+      }
+    }
+  }
+  if (output_ok && !out.empty() && !isCancelled())
+  {
+    writeOut(out);
+  }
+
+  for (size_t i = 0; i < files.size(); i++)
+  {
+    if (files[i].data != nullptr)
+      munmap((void*)files[i].data, files[i].len);
+    if (files[i].fd != -1)
+      close(files[i].fd);
+  }
+  for (size_t i = 0; i < regexes.size(); i++)
+  {
+    regfree(regexes[i]);
+    delete regexes[i];
+  }
+}
+/******************SEARCH COMMAND*/
+
+/*WALK COMMAND***************/
+#define WALK_OUT_FLUSH (64 << 10) // a worker writes its printed paths once it has this much
+
+// 'f' / 'd' / 'l' / 'o'(ther) from an entry type or a mode, 0 when getdents64 does not know
+static char _direntType(unsigned char d_type)
+{
+  switch (d_type)
+  {
+  case DT_REG:
+    return 'f';
+  case DT_DIR:
+    return 'd';
+  case DT_LNK:
+    return 'l';
+  case DT_UNKNOWN:
+    return 0;
+  default:
+    return 'o';
+  }
+}
+
+static char _modeType(mode_t mode)
+{
+  if (S_ISREG(mode))
+    return 'f';
+  if (S_ISDIR(mode))
+    return 'd';
+  if (S_ISLNK(mode))
+    return 'l';
+  return 'o';
+}
+
+// [+-]N into cmp (1, -1, 0) and N
+static bool _parseWalkNumber(const std::string& arg, int* cmp, unsigned long long* value, std::string* suffix)
+{
+  size_t pos = 0;
+  *cmp = 0;
+  if (!arg.empty() && (arg[0] == '+' || arg[0] == '-'))
+  {
+    *cmp = (arg[0] == '+') ? 1 : -1;
+    pos = 1;
+  }
+  size_t digits = arg.find_first_not_of("0123456789", pos);
+  if (digits == pos)
+    return false;
+  *value = strtoull(arg.c_str() + pos, nullptr, 10);
+  *suffix = (digits == string::npos) ? "" : arg.substr(digits);
+  return true;
+}
+
+static bool _compareWalkNumber(unsigned long long actual, int cmp, unsigned long long wanted)
+{
+  return (cmp == 1) ? actual > wanted : (cmp == -1) ? actual < wanted : actual == wanted;
+}
+
+WalkCommand::WalkCommand(const char *cmd_line) : BuiltInCommand(cmd_line), type(0), size_cmp(2), size_value(0), size_unit(512),
+  mtime_cmp(2), mtime_days(0), print0(false), touch(false), now(0), pending(0), failed(false) {}
+bool WalkCommand::canRunInBackground() const
+{
+  return true;
+}
+
+bool WalkCommand::canRunInPipe() const
+{
+  return true;
+}
+
+// walk [dir ...] [-name glob] [-type f|d|l] [-size [+-]N[cwbkMG]] [-mtime [+-]N] [-print0] [-touch timestamp]
+bool WalkCommand::parseArgs(std::vector<std::string>& roots)
+{
+  int i = 1;
+  for (; i < c_num_of_args && c_args[i][0] != '-'; i++)
+  {
+    std::vector<std::string> matches = _expandGlob(c_args[i]);
+    roots.insert(roots.end(), matches.begin(), matches.end());
+  }
+  if (roots.empty())
+  {
+    roots.push_back(".");
+  }
+  for (; i < c_num_of_args; i++)
   {
-    fd = open(output_file_string.c_str(),O_CREAT | O_RDWR | O_TRUNC, 0655);
-    if(fd == -1)
+    std::string option = c_args[i];
+    if (option == "-print0")
     {
-      perror("smash error: open failed");
-      dup2(5,1);
-      return;
+      print0 = true;
+      continue;
+    }
+    if (i + 1 >= c_num_of_args)
+      return false;
+    std::string value = c_args[++i];
+    if (option == "-name")
+    {
+      // the smash has no quoting, so '*.gz' arrives with its quotes
+      if (value.size() >= 2 && (value[0] == '\'' || value[0] == '"') && value[value.size() - 1] == value[0])
+        value = value.substr(1, value.size() - 2);
+      name_glob = value;
+    }
+    else if (option == "-type")
+    {
+      if (value != "f" && value != "d" && value != "l")
+        return false;
+      type = value[0];
+    }
+    else if (option == "-size")
+    {
+      std::string suffix;
+      if (!_parseWalkNumber(value, &size_cmp, &size_value, &suffix) || suffix.size() > 1)
+        return false;
+      const char* units = "cwbkMG";
+      unsigned long long unit_sizes[] = {1, 2, 512, 1ULL << 10, 1ULL << 20, 1ULL << 30};
+      if (!suffix.empty())
+      {
+        const char* unit = strchr(units, suffix[0]);
+        if (unit == nullptr)
+          return false;
+        size_unit = unit_sizes[unit - units];
+      }
+    }
+    else if (option == "-mtime")
+    {
+      std::string suffix;
+      unsigned long long days;
+      if (!_parseWalkNumber(value, &mtime_cmp, &days, &suffix) || !suffix.empty())
+        return false;
+      mtime_days = days;
+    }
+    else if (option == "-touch")
+    {
+      if (!_parseTimestamp(value.c_str(), &touch_time))
+        return false;
+      touch = true;
+    }
+    else
+    {
+      return false;
     }
   }
+  return true;
+}
 
-  SmallShell& smash = SmallShell::getInstance();
-  smash.executeCommand(cmd_string.c_str());
-  if(close(fd) == -1)
+bool WalkCommand::needsStat() const
+{
+  return size_cmp != 2 || mtime_cmp != 2;
+}
+
+// like find: sizes are rounded up to whole units, ages down to whole days
+bool WalkCommand::matches(const char* name, char entry_type, const struct stat* st) const
+{
+  if (type != 0 && entry_type != type)
+    return false;
+  if (!name_glob.empty() && fnmatch(name_glob.c_str(), name, 0) != 0)
+    return false;
+  if (size_cmp != 2 && !_compareWalkNumber((st->st_size + size_unit - 1) / size_unit, size_cmp, size_value))
+    return false;
+  if (mtime_cmp != 2)
   {
-    perror("smash error: close failed");
-    dup2(5,1);
-    return;
+    time_t age = now - st->st_mtime;
+    if (!_compareWalkNumber(age < 0 ? 0 : age / (24 * 60 * 60), mtime_cmp, mtime_days))
+      return false;
   }
-  if(dup2(5,1)==-1)
+  return true;
+}
+
+void WalkCommand::found(WalkWorker& worker, const std::string& path)
+{
+  if (touch)
   {
-    perror("smash error: dup2 failed");
+    worker.touched.push_back(path);
     return;
   }
+  worker.out += path;
+  worker.out += print0 ? '\0' : '\n';
+  if (worker.out.size() >= WALK_OUT_FLUSH)
+    flush(worker);
 }
-/******************REDIRECTION COMMAND*/
 
-/*PIPE COMMANDS***************/
+void WalkCommand::flush(WalkWorker& worker)
+{
+  if (worker.out.empty())
+    return;
+  std::lock_guard<std::mutex> guard(out_lock);
+  if (!failed && !writeOut(worker.out))
+    failed = true;
+  worker.out.clear();
+}
 
-PipeCommand::PipeCommand(const char* cmd_line, bool _ch_stdout, size_t _pos): Command(cmd_line), ch_stdout(_ch_stdout), pos(_pos) {}
-void PipeCommand::execute()
+// the newest directory of this worker, else the oldest one of the first worker that has any
+bool WalkCommand::nextDir(size_t self, std::string& dir)
 {
-  //divide the cmd line to its command 1 and command 2
-  size_t x = (ch_stdout == true) ? 3 : 4;
-  std::string cmd_1 = c_cmd_line.substr(0,pos);
-  std::string cmd_2 = c_cmd_line.substr(pos+x ,c_cmd_line.size() - cmd_1.size() - x);
-  
-  SmallShell &smash = SmallShell::getInstance();
-  int my_pipe[2]; // close shell pipe
-  if (pipe(my_pipe) == -1)
+  for (size_t k = 0; k < workers.size(); k++)
   {
-    perror("smash error: pipe failed");
-    return;
+    WalkWorker& victim = *workers[(self + k) % workers.size()];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (victim.dirs.empty())
+      continue;
+    if (k == 0)
+    {
+      dir = victim.dirs.back();
+      victim.dirs.pop_back();
+    }
+    else
+    {
+      dir = victim.dirs.front();
+      victim.dirs.pop_front();
+    }
+    return true;
   }
-  pid_t p = fork();
-  //fork command 1 and wait for it to finish
-  if (p == -1){
-    perror("smash error: fork failed");
-    return; 
+  return false;
+}
+
+// lists one directory: matching entries are reported, sub directories (never followed
+// through symlinks) are queued on this worker
+void WalkCommand::walkDir(WalkWorker& worker, const std::string& path)
+{
+  int fd = openat(AT_FDCWD, path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  std::vector<DirCache::DirEntry> entries;
+  if (fd == -1 || !_readDirEntries(fd, entries))
+  {
+    std::lock_guard<std::mutex> guard(out_lock);
+    std::cerr << "smash error: walk: " << path << ": " << strerror(errno) << std::endl;
+    if (fd != -1)
+      close(fd);
+    return;
   }
-  if (p == 0) { // child = execute command 1  
-    setpgrp();
-    if (close(my_pipe[0]) == -1) // close cmd1 pipe's read channel
+  std::string prefix = (path[path.size() - 1] == '/') ? path : path + "/";
+  bool need_stat = needsStat();
+  std::vector<std::string> sub_dirs;
+  for (size_t i = 0; i < entries.size() && !isCancelled(); i++)
+  {
+    const char* name = entries[i].name.c_str();
+    char entry_type = _direntType(entries[i].type);
+    struct stat st;
+    if (need_stat || entry_type == 0)
     {
-       perror("smash error: close failed");
+      if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+        continue; // removed while we walk
+      entry_type = _modeType(st.st_mode);
     }
-    
-    if (ch_stdout)  // got " | "
-    { 
-      if (dup2(my_pipe[1],1)==-1) //cmd1 stdout -> pipe's write channel
-      {
-        perror("smash error: dup2 failed");
-        return;
-      }
+    if (matches(name, entry_type, &st))
+      found(worker, prefix + name);
+    if (entry_type == 'd')
+      sub_dirs.push_back(prefix + name);
+  }
+  close(fd);
+  if (!sub_dirs.empty())
+  {
+    pending += sub_dirs.size();
+    std::lock_guard<std::mutex> guard(worker.lock);
+    worker.dirs.insert(worker.dirs.end(), sub_dirs.begin(), sub_dirs.end());
+  }
+}
+
+void WalkCommand::execute()
+{
+  std::vector<std::string> roots;
+  if (!parseArgs(roots))
+  {
+    std::cerr << "smash error: walk: invalid arguments" << std::endl;
+    return;
+  }
+  now = time(nullptr);
+  ThreadPool* pool = SmallShell::getInstance().getThreadPool();
+  for (size_t i = 0; i <= pool->size(); i++) // the pool workers and the calling thread
+  {
+    workers.push_back(std::unique_ptr<WalkWorker>(new WalkWorker()));
+  }
+
+  for (size_t i = 0; i < roots.size(); i++) // like find, the roots themselves are tested too
+  {
+    struct stat st;
+    if (lstat(roots[i].c_str(), &st) == -1)
+    {
+      std::cerr << "smash error: walk: " << roots[i] << ": " << strerror(errno) << std::endl;
+      continue;
     }
-    else  // got " |& "
+    std::string base = roots[i]; // "/" stays "/", "a/b/" is "b"
+    size_t end = roots[i].find_last_not_of('/');
+    if (end != string::npos)
     {
-      if (dup2(my_pipe[1],2)==-1)// cmd1 stderr -> pipe's write channel
-      {
-        perror("smash error: dup2 failed");
-        return;
-      }
+      size_t start = roots[i].rfind('/', end);
+      start = (start == string::npos) ? 0 : start + 1;
+      base = roots[i].substr(start, end + 1 - start);
     }
-    close(my_pipe[1]);
-    smash.executeCommand(cmd_1.c_str());
-    exit(0);
+    if (matches(base.c_str(), _modeType(st.st_mode), &st))
+      found(*workers[0], roots[i]);
+    if (S_ISDIR(st.st_mode))
+    {
+      pending++;
+      workers[0]->dirs.push_back(roots[i]);
     }
-    if (p > 0) //father(smash) wait for cmd1 to finish and execute cmd2
+  }
+
+  pool->parallelFor(workers.size(), [this](size_t self) {
+    WalkWorker& worker = *workers[self];
+    unsigned idle = 0;
+    while (pending > 0 && !isCancelled() && !failed)
     {
-      if (close(my_pipe[1]) == -1) // close smash's pipe's write channel
-      {
-        perror("smash error: close failed");
-        return;
-      }
-      if (dup2(0,5)==-1) { //save smash's stdin in fd 5 to restore it later
-        perror("smash error: dup2 failed");
-        return;
-      }
-      if (dup2(my_pipe[0],0)==-1) // pipe's read channel -> cmd2(smash) stdin
-      {
-        perror("smash error: dup2 failed");
-        return;
-      }
-      if (close(my_pipe[0]) == -1) //smash doesnt need pipe anymore close its read channel
+      std::string dir;
+      if (!nextDir(self, dir)) // everything left is being listed right now - wait for new work
       {
-       perror("smash error: close failed");
-       return;
+        if (++idle < 64)
+          std::this_thread::yield();
+        else
+          usleep(100);
+        continue;
       }
+      idle = 0;
+      walkDir(worker, dir);
+      pending--; // only after its sub directories were queued
+    }
+    flush(worker);
+  });
 
-      int cmd1_status = 0;
-      waitpid(p,&cmd1_status,0);
-      smash.setIsPiped(false);
-      smash.executeCommand(cmd_2.c_str());
-      if (dup2(5,0)==-1) //restore pipe's stdin
-      { 
-       perror("smash error: dup2 failed");
-       return;
-      }
-    }     
+  if (touch && !isCancelled())
+  {
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+      paths.insert(paths.end(), workers[i]->touched.begin(), workers[i]->touched.end());
+    }
+    _touchPaths(paths, touch_time, this);
+  }
 }
-/******************PIPE COMMANDS*/
+/******************WALK COMMAND*/
 
-/*TAIL COMMAND***************/
-TailCommand::TailCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
-void TailCommand::execute()
+/*DAG COMMAND***************/
+enum { DAG_WAITING, DAG_RUNNING, DAG_DONE, DAG_FAILED, DAG_SKIPPED };
+
+DagCommand::DagCommand(const char *cmd_line, JobsList* jobs) : BuiltInCommand(cmd_line), c_jobs(jobs) {}
+
+bool DagCommand::parseDagFile(const char* path, std::vector<DagNode>& nodes)
 {
-  if (c_num_of_args > 3 || c_num_of_args < 2)
+  std::ifstream file(path);
+  if (!file.is_open())
   {
-    std::cerr << "smash error: tail: invalid arguments" << std::endl;
-    return;
+    std::cerr << "smash error: dag: cannot open " << path << std::endl;
+    return false;
+  }
+  std::map<std::string, int> index;
+  std::string line;
+  int line_num = 0;
+  while (std::getline(file, line))
+  {
+    line_num++;
+    line = _trim(line);
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    size_t colon = line.find(':');
+    size_t arrow = line.find("->");
+    if (colon == string::npos || arrow == string::npos || colon > arrow || _trim(line.substr(0, colon)).empty() || _trim(line.substr(arrow + 2)).empty())
+    {
+      std::cerr << "smash error: dag: syntax error in line " << line_num << std::endl;
+      return false;
+    }
+    DagNode node;
+    node.name = _trim(line.substr(0, colon));
+    node.cmd = _trim(line.substr(arrow + 2));
+    if (node.cmd[node.cmd.size() - 1] == '&') // every node already runs in the background
+    {
+      node.cmd = _rtrim(node.cmd.substr(0, node.cmd.size() - 1));
+    }
+    std::istringstream deps(line.substr(colon + 1, arrow - colon - 1));
+    for (std::string dep; deps >> dep;)
+    {
+      node.deps.push_back(dep);
+    }
+    node.unmet_deps = node.deps.size();
+    node.pid = -1;
+    node.state = DAG_WAITING;
+    node.exit_status = 0;
+    node.start_time = node.end_time = 0;
+    if (index.count(node.name))
+    {
+      std::cerr << "smash error: dag: node " << node.name << " is defined twice" << std::endl;
+      return false;
+    }
+    index[node.name] = nodes.size();
+    nodes.push_back(node);
   }
 
-  const char* minus_N = c_args[1]; 
-  char* last_lines = (char*)malloc(strlen(minus_N));
-  strcpy(last_lines, minus_N+1);
-  
-  if (c_num_of_args == 3 && ( (minus_N[0] != '-') || (!isANumber(last_lines)) ) )
+  for (size_t i = 0; i < nodes.size(); i++)
   {
-    std::cerr << "smash error: tail: invalid arguments" << std::endl;
-    free(last_lines); 
-    return;
+    for (size_t j = 0; j < nodes[i].deps.size(); j++)
+    {
+      std::map<std::string, int>::iterator it = index.find(nodes[i].deps[j]);
+      if (it == index.end())
+      {
+        std::cerr << "smash error: dag: unknown dependency " << nodes[i].deps[j] << " of " << nodes[i].name << std::endl;
+        return false;
+      }
+      nodes[it->second].dependents.push_back(i);
+    }
   }
-  int num_lines;
-  char* file_path;
-  if(c_num_of_args == 2)
+
+  // Kahn's algorithm - if not every node can be ordered there is a cycle
+  std::vector<int> unmet(nodes.size());
+  std::vector<int> order;
+  for (size_t i = 0; i < nodes.size(); i++)
   {
-    num_lines = N;
-    file_path = c_args[1];
+    unmet[i] = nodes[i].unmet_deps;
+    if (unmet[i] == 0)
+      order.push_back(i);
   }
-  else //3 args
+  for (size_t k = 0; k < order.size(); k++)
   {
-    file_path = c_args[2];
-    num_lines= atoi(last_lines);   
+    const std::vector<int>& next = nodes[order[k]].dependents;
+    for (size_t j = 0; j < next.size(); j++)
+    {
+      if (--unmet[next[j]] == 0)
+        order.push_back(next[j]);
+    }
   }
-  free(last_lines);
+  if (order.size() != nodes.size())
+  {
+    std::cerr << "smash error: dag: dependency cycle detected" << std::endl;
+    return false;
+  }
+  return true;
+}
 
-  int fd = open(file_path, O_RDONLY);
-  if (fd == -1)
+void DagCommand::printReport(const std::vector<DagNode>& nodes, double total_time)
+{
+  int done = 0, failed = 0, skipped = 0;
+  for (size_t i = 0; i < nodes.size(); i++)
   {
-    perror("smash error: open failed"); 
-    return;
+    done += (nodes[i].state == DAG_DONE);
+    failed += (nodes[i].state == DAG_FAILED);
+    skipped += (nodes[i].state == DAG_SKIPPED);
+  }
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "dag: " << nodes.size() << " nodes, " << done << " succeeded, " << failed << " failed, "
+            << skipped << " skipped in " << total_time << " secs" << std::endl;
+  for (size_t i = 0; i < nodes.size(); i++)
+  {
+    const DagNode& node = nodes[i];
+    std::cout << "  " << std::left << std::setw(16) << node.name << std::right;
+    if (node.state == DAG_SKIPPED)
+    {
+      std::cout << " skipped" << std::endl;
+      continue;
+    }
+    std::cout << " " << node.start_time << "s -> " << node.end_time << "s (" << node.end_time - node.start_time << "s)";
+    if (node.state == DAG_FAILED)
+    {
+      if (WIFSIGNALED(node.exit_status))
+        std::cout << " failed: killed by signal " << WTERMSIG(node.exit_status);
+      else
+        std::cout << " failed: exit status " << WEXITSTATUS(node.exit_status);
+    }
+    std::cout << std::endl;
   }
 
-  int total_lines_counter=0, total_bytes_counter=0;
-  char buf[1], prev_char[1]; //prev char will be used for counting lines 
-  int res = 0;
-  res = read(fd,prev_char,1);
-  if (res == -1)
+  // the critical path ends at the node that finished last and follows, at every step,
+  // the dependency that finished last (the one the node actually waited for)
+  int last = -1;
+  for (size_t i = 0; i < nodes.size(); i++)
   {
-    perror("smash error: read failed");
-    close(fd);
-    return;
+    if (nodes[i].state != DAG_SKIPPED && (last == -1 || nodes[i].end_time > nodes[last].end_time))
+      last = i;
   }
-  ++total_bytes_counter;
-  if (res == 0) // case file is empty (read syscall returned EOF) close file and return
+  if (last != -1)
   {
-    if(close(fd) == -1)
+    std::map<std::string, int> index;
+    for (size_t i = 0; i < nodes.size(); i++)
+      index[nodes[i].name] = i;
+    std::vector<int> path;
+    for (int curr = last; curr != -1;)
     {
-      perror("smash error: close failed");
+      path.push_back(curr);
+      int pred = -1;
+      for (size_t j = 0; j < nodes[curr].deps.size(); j++)
+      {
+        int dep = index[nodes[curr].deps[j]];
+        if (pred == -1 || nodes[dep].end_time > nodes[pred].end_time)
+          pred = dep;
+      }
+      curr = pred;
+    }
+    std::cout << "critical path:";
+    for (int i = path.size() - 1; i >= 0; i--)
+    {
+      const DagNode& node = nodes[path[i]];
+      std::cout << " " << node.name << " (" << node.end_time - node.start_time << "s)" << (i > 0 ? " ->" : "");
+    }
+    std::cout << " = " << nodes[last].end_time << " secs" << std::endl;
+  }
+  std::cout.unsetf(std::ios::floatfield);
+  std::cout << std::setprecision(6);
+}
+
+void DagCommand::finishNode(std::vector<DagNode>& nodes, int i, int status, std::list<int>& ready)
+{
+  DagNode& node = nodes[i];
+  node.exit_status = status;
+  if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+  {
+    node.state = DAG_DONE;
+    for (size_t j = 0; j < node.dependents.size(); j++)
+    {
+      if (--nodes[node.dependents[j]].unmet_deps == 0 && nodes[node.dependents[j]].state == DAG_WAITING)
+        ready.push_back(node.dependents[j]);
     }
     return;
   }
-  
-  do        //counting num of lines and bytes in given file
-  { 
-    res = read(fd, buf, 1);
-    if (res == 1 && (prev_char[0] == '\n') && (buf[0] != EOF)){   //doesnt count empty lines at the end (= count a line only if prev char is '/n' and we havent reached EOF)
-      total_lines_counter++;
-    }  
-    prev_char[0] = buf[0];
-    total_bytes_counter = (res == 1) ? total_bytes_counter + 1 : total_bytes_counter;
-  } while (res == 1);
+  // short-circuit: everything downstream of a failed node is skipped
+  node.state = DAG_FAILED;
+  std::vector<int> stack(node.dependents);
+  while (!stack.empty())
+  {
+    DagNode& dependent = nodes[stack.back()];
+    stack.pop_back();
+    if (dependent.state != DAG_WAITING)
+      continue;
+    dependent.state = DAG_SKIPPED;
+    stack.insert(stack.end(), dependent.dependents.begin(), dependent.dependents.end());
+  }
+}
 
-  if(res == -1)
+void DagCommand::execute()
+{
+  int workers = sysconf(_SC_NPROCESSORS_ONLN);
+  const char* path = nullptr;
+  if (c_num_of_args == 2)
   {
-    perror("smash error: read failed");
-    close(fd);
+    path = c_args[1];
+  }
+  else if (c_num_of_args == 4 && strcmp(c_args[1], "-j") == 0 && isANumber(c_args[2]) && atoi(c_args[2]) > 0)
+  {
+    workers = atoi(c_args[2]);
+    path = c_args[3];
+  }
+  else
+  {
+    std::cerr << "smash error: dag: invalid arguments" << std::endl;
     return;
   }
+  if (workers < 1)
+    workers = 1;
 
-  //moving seek pointer to begenning of file and moving it forward to where it should start reading from
-  lseek(fd, 0, SEEK_SET);
-  char* txt_buf = new char[total_bytes_counter];
-  int unread_bytes =0;
-  if(total_lines_counter < num_lines) //case reading the whole file
+  std::vector<DagNode> nodes;
+  if (!parseDagFile(path, nodes))
+    return;
+
+  std::list<int> ready;
+  for (size_t i = 0; i < nodes.size(); i++)
   {
-    if (read(fd,txt_buf,total_bytes_counter) != total_bytes_counter)
+    if (nodes[i].unmet_deps == 0)
+      ready.push_back(i);
+  }
+
+  SmallShell& smash = SmallShell::getInstance();
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  bool polling = epoll_fd == -1; // nodes without a pidfd are looked at every 10ms instead
+  int interrupts = smash.getInterrupts();
+  bool interrupted = false;
+  double dag_start = _monotonicSeconds();
+  int running = 0;
+  std::map<pid_t, int> by_pid;
+  while (running > 0 || (!ready.empty() && !interrupted))
+  {
+    if (!interrupted && (isCancelled() || smash.getInterrupts() != interrupts))
     {
-      perror("smash error: read failed");
-      close(fd);
-      delete[] txt_buf;
-      return;
+      // ctrl-C: nothing more is started, the running nodes are killed and reaped below
+      interrupted = true;
+      for (std::map<pid_t, int>::iterator it = by_pid.begin(); it != by_pid.end(); it++)
+      {
+        JobsList::JobEntry* job = c_jobs->getJobByPid(it->first);
+        if (job != nullptr && job->signal(0) == 0)
+          kill(-it->first, SIGKILL);
+      }
+      for (size_t i = 0; i < nodes.size(); i++)
+      {
+        if (nodes[i].state == DAG_WAITING)
+          nodes[i].state = DAG_SKIPPED;
+      }
+      ready.clear();
     }
-   
-  }
-  else{ //case reading given number of lines
-    int unread_lines_cnt = total_lines_counter - num_lines;
-    do
+
+    // launch every ready node we have room for, through the usual background path
+    while (!ready.empty() && running < workers)
     {
-      res = read(fd, buf, 1);
-      if (res == 1 && (buf[0] == '\n')){ 
-        unread_lines_cnt--;
+      int i = ready.front();
+      ready.pop_front();
+      std::string bg_cmd = nodes[i].cmd + "&";
+      ExternalCommand cmd(bg_cmd.c_str(), c_jobs);
+      cmd.setPid(-1);
+      nodes[i].start_time = _monotonicSeconds() - dag_start;
+      cmd.execute();
+      smash.setCurrentCommand(nullptr); // cmd is gone after this iteration
+      if (cmd.getPid() <= 0) // fork failed
+      {
+        nodes[i].end_time = nodes[i].start_time;
+        finishNode(nodes, i, 127 << 8, ready);
+        continue;
       }
-      unread_bytes = (res == 1) ? unread_bytes + 1 : unread_bytes;     
+      nodes[i].pid = cmd.getPid();
+      nodes[i].state = DAG_RUNNING;
+      by_pid[nodes[i].pid] = i;
+      c_jobs->watchProccess(nodes[i].pid);
+      running++;
+      JobsList::JobEntry* job = c_jobs->getJobByPid(nodes[i].pid);
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.u64 = nodes[i].pid;
+      // a closed pidfd (its job was reaped) leaves the epoll by itself
+      if (job != nullptr && epoll_fd != -1 && (job->getPidFd() == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, job->getPidFd(), &event) == -1))
+        polling = true;
+    }
+    if (running == 0)
+      continue;
 
-    } while(res == 1 && unread_lines_cnt >= 0);
-    if(res == -1)
+    c_jobs->removeFinishedJobs();
+    std::vector<std::pair<pid_t, int> > finished;
+    for (std::map<pid_t, int>::iterator it = by_pid.begin(); it != by_pid.end(); it++)
     {
-     perror("smash error: read failed");
-     close(fd);
-     delete[] txt_buf;
-     return;
+      int status;
+      if (c_jobs->takeWatchedStatus(it->first, &status))
+        finished.push_back(std::make_pair(it->first, status));
     }
-  
-    if (read(fd,txt_buf,total_bytes_counter) == -1) 
+    if (finished.empty())
     {
-      perror("smash error: read failed");
-      close(fd);
-      delete[] txt_buf;
+      struct epoll_event events[64];
+      if (epoll_fd == -1)
+        usleep(10000);
+      else if (epoll_wait(epoll_fd, events, 64, polling ? 10 : -1) == -1 && errno != EINTR)
+      {
+        perror("smash error: epoll_wait failed");
+        polling = true;
+      }
+      continue;
+    }
+
+    for (size_t k = 0; k < finished.size(); k++)
+    {
+      int i = by_pid[finished[k].first];
+      by_pid.erase(finished[k].first);
+      nodes[i].end_time = _monotonicSeconds() - dag_start;
+      running--;
+      finishNode(nodes, i, finished[k].second, ready);
     }
   }
+  if (epoll_fd != -1)
+    close(epoll_fd);
+  printReport(nodes, _monotonicSeconds() - dag_start);
+}
+/******************DAG COMMAND*/
 
-  //here, txt buf has needed info, write it to the screen  
-  if(close(fd) == -1)
+/*THREAD POOL***************/
+ThreadPool::ThreadPool(int num_of_threads) : stopping(false)
+{
+  // the workers inherit a fully blocked signal mask, so ctrl-Z/ctrl-C/alarm always reach the main thread
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  for (int i = 0; i < num_of_threads; i++)
   {
-    perror("smash error: close failed"); 
-    return;
+    workers.push_back(std::thread(&ThreadPool::workerLoop, this));
   }
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+}
 
-  if (write(1, txt_buf, total_bytes_counter - unread_bytes) == -1)
+ThreadPool::~ThreadPool()
+{
   {
-    perror("smash error: write failed");
-    return;
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  cond.notify_all();
+  for (size_t i = 0; i < workers.size(); i++)
+  {
+    workers[i].join();
   }
-  delete[] txt_buf;
 }
-/******************TAIL COMMAND*/
 
-/*TOUCH COMMAND***************/
-TouchCommand::TouchCommand(const char *cmd_line) : BuiltInCommand(cmd_line) {}
-void TouchCommand::execute()
+void ThreadPool::workerLoop()
 {
-  if (c_num_of_args != 3){
-    std::cerr << "smash error: touch: invalid arguments" << std::endl;
-    return;
+  while (true)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      cond.wait(guard, [this]() { return stopping || !tasks.empty(); });
+      if (tasks.empty()) // stopping and nothing left to do
+        return;
+      task = tasks.front();
+      tasks.pop_front();
+    }
+    task();
   }
-  struct tm info = {0};
-  const char* file = c_args[1];
-
-  char delim[] = ":";
-  char *ptr = strtok(c_args[2], delim);
-  char* date_cmps[6];
-  int i = 0;
-  while(ptr != nullptr)
-	{
-		date_cmps[i] = new char[strlen(ptr) + 1]; 
-    strcpy(date_cmps[i],ptr);
-    ptr = strtok(nullptr, delim);
-    ++i;
-	}
-
-  i=0;
-  info.tm_sec = atoi(date_cmps[i++]);
-  info.tm_min = atoi(date_cmps[i++]);
-  info.tm_hour = atoi(date_cmps[i++]);
-  info.tm_mday = atoi(date_cmps[i++]);
-  info.tm_mon = atoi(date_cmps[i++]) -1;
-  info.tm_year = atoi(date_cmps[i]) - 1900;
+}
 
-  for (int i = 0; i < 6; i++)
+void ThreadPool::submit(std::function<void()> task)
+{
   {
-    delete[] date_cmps[i];
+    std::lock_guard<std::mutex> guard(lock);
+    tasks.push_back(task);
   }
+  cond.notify_one();
+}
 
-  time_t ret = mktime(&info);
-  if (ret == -1)
+struct ParallelForState
+{
+  std::atomic<size_t> next;
+  std::atomic<size_t> done;
+  size_t count;
+  std::function<void(size_t)> func;
+  std::mutex lock;
+  std::condition_variable cond;
+  struct rusage helpers_usage; // RUSAGE_THREAD of the items the workers ran, under lock
+};
+
+// a worker (is_helper) adds its time for every item before the item counts as done
+static void _parallelForWork(std::shared_ptr<ParallelForState> state, bool is_helper)
+{
+  for (size_t i = state->next++; i < state->count; i = state->next++)
   {
-    perror("smash error: mktime failed");
+    struct rusage before, after;
+    if (is_helper)
+      getrusage(RUSAGE_THREAD, &before);
+    state->func(i);
+    if (is_helper)
+    {
+      getrusage(RUSAGE_THREAD, &after);
+      std::lock_guard<std::mutex> guard(state->lock);
+      timersub(&after.ru_utime, &before.ru_utime, &after.ru_utime);
+      timersub(&after.ru_stime, &before.ru_stime, &after.ru_stime);
+      timeradd(&state->helpers_usage.ru_utime, &after.ru_utime, &state->helpers_usage.ru_utime);
+      timeradd(&state->helpers_usage.ru_stime, &after.ru_stime, &state->helpers_usage.ru_stime);
+    }
+    if (++state->done == state->count)
+    {
+      std::lock_guard<std::mutex> guard(state->lock);
+      state->cond.notify_all();
+    }
+  }
+}
+
+void ThreadPool::parallelFor(size_t count, std::function<void(size_t)> func)
+{
+  if (count == 0)
     return;
+  std::shared_ptr<ParallelForState> state(new ParallelForState());
+  state->next = 0;
+  state->done = 0;
+  state->count = count;
+  state->func = func;
+  memset(&state->helpers_usage, 0, sizeof(state->helpers_usage));
+  size_t helpers = std::min(workers.size(), count - 1);
+  for (size_t i = 0; i < helpers; i++)
+  {
+    submit([state]() { _parallelForWork(state, true); });
   }
+  _parallelForWork(state, false);
+  std::unique_lock<std::mutex> guard(state->lock);
+  state->cond.wait(guard, [&state]() { return state->done == state->count; });
+  _addPoolUsage(state->helpers_usage);
+}
+
+size_t ThreadPool::size() const
+{
+  return workers.size();
+}
 
-  struct utimbuf time;
-  time.actime = ret;
-  time.modtime = ret;
+BuiltInTask::BuiltInTask(Command* _cmd) : cmd(_cmd), finished(false), wall_time(0)
+{
+  memset(&usage, 0, sizeof(usage));
+  done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+}
+
+BuiltInTask::~BuiltInTask()
+{
+  if (done_fd != -1)
+    close(done_fd);
+  delete cmd;
+}
 
-  if(utime(file, &time) == -1)
+// the usage of the thread itself, so the numbers are the built-in's and not the whole smash's
+void BuiltInTask::run()
+{
+  struct rusage before, after;
+  struct rusage pool_before = t_pool_usage;
+  getrusage(RUSAGE_THREAD, &before);
+  double start = _monotonicSeconds();
+  cmd->execute();
+  getrusage(RUSAGE_THREAD, &after);
+  std::lock_guard<std::mutex> guard(lock);
+  wall_time = _monotonicSeconds() - start;
+  usage = after;
+  timersub(&after.ru_utime, &before.ru_utime, &usage.ru_utime);
+  timersub(&after.ru_stime, &before.ru_stime, &usage.ru_stime);
+  // the workers that helped it (parallelFor) count as well
+  timeradd(&usage.ru_utime, &t_pool_usage.ru_utime, &usage.ru_utime);
+  timeradd(&usage.ru_stime, &t_pool_usage.ru_stime, &usage.ru_stime);
+  timersub(&usage.ru_utime, &pool_before.ru_utime, &usage.ru_utime);
+  timersub(&usage.ru_stime, &pool_before.ru_stime, &usage.ru_stime);
+  usage.ru_minflt = after.ru_minflt - before.ru_minflt;
+  usage.ru_majflt = after.ru_majflt - before.ru_majflt;
+  usage.ru_nvcsw = after.ru_nvcsw - before.ru_nvcsw;
+  usage.ru_nivcsw = after.ru_nivcsw - before.ru_nivcsw;
+  finished = true;
+  cond.notify_all();
+  if (done_fd != -1)
   {
-    perror("smash error: utime failed");
-    return;
+    uint64_t one = 1;
+    if (write(done_fd, &one, sizeof(one)) == -1) {} // never full: it is written once
   }
 }
-/******************TOUCH COMMAND*/
+
+void BuiltInTask::cancel()
+{
+  cmd->cancel();
+}
+
+bool BuiltInTask::isFinished() const
+{
+  return finished;
+}
+
+void BuiltInTask::waitFinished()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  cond.wait(guard, [this]() { return (bool)finished; });
+}
+
+int BuiltInTask::getDoneFd() const
+{
+  return done_fd;
+}
+
+Command* BuiltInTask::getCommand() const
+{
+  return cmd;
+}
+
+double BuiltInTask::getWallTime() const
+{
+  return wall_time;
+}
+
+const struct rusage& BuiltInTask::getUsage() const
+{
+  return usage;
+}
+/******************THREAD POOL*/
 
 /*JOBLIST COMMANDS***************/
 
 //JOB ENTRY COMMANDS
+int _pidfdOpen(pid_t pid)
+{
+  return syscall(SYS_pidfd_open, pid, 0);
+}
+
+// the SIGALRM handler reaps finished sons, so it is held off until the pidfd is open
+pid_t _forkWithPidFd(int* pidfd)
+{
+  sigset_t alarm, old;
+  sigemptyset(&alarm);
+  sigaddset(&alarm, SIGALRM);
+  pthread_sigmask(SIG_BLOCK, &alarm, &old);
+  pid_t p = fork();
+  *pidfd = (p > 0) ? _pidfdOpen(p) : -1;
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+  return p;
+}
+
+int _sendSignal(int pidfd, pid_t pid, int sig)
+{
+  if (pidfd == -1)
+    return kill(pid, sig);
+  return syscall(SYS_pidfd_send_signal, pidfd, sig, nullptr, 0);
+}
+
+JobsList::JobEntry::JobEntry() : pidfd(-1) {}
+
+JobsList::JobEntry::~JobEntry()
+{
+  if (pidfd != -1)
+    close(pidfd);
+}
+
 void JobsList::JobEntry::setJobID(pid_t jobId)
 {
   job_id = jobId; 
@@ -920,6 +5736,16 @@ void JobsList::JobEntry::setInitTime(time_t initTime)
   init_time = initTime;
 }
 
+void JobsList::JobEntry::setStartTime(double startTime)
+{
+  start_time = startTime;
+}
+
+double JobsList::JobEntry::getStartTime() const
+{
+  return start_time;
+}
+
 time_t JobsList::JobEntry::getInitTime() const
 {
   return init_time;
@@ -944,6 +5770,36 @@ void JobsList::JobEntry::setIsFinished(bool isFinished)
   is_finished = isFinished; 
 }
 
+std::shared_ptr<BuiltInTask> JobsList::JobEntry::getTask() const
+{
+  return task;
+}
+
+void JobsList::JobEntry::setTask(std::shared_ptr<BuiltInTask> _task)
+{
+  task = _task;
+}
+
+bool JobsList::JobEntry::isBuiltIn() const
+{
+  return task != nullptr;
+}
+
+void JobsList::JobEntry::setPidFd(int _pidfd)
+{
+  pidfd = _pidfd;
+}
+
+int JobsList::JobEntry::getPidFd() const
+{
+  return pidfd;
+}
+
+int JobsList::JobEntry::signal(int sig) const
+{
+  return _sendSignal(pidfd, proccess_id, sig);
+}
+
 //JobsList functions
 JobsList::~JobsList()
 {
@@ -954,22 +5810,39 @@ JobsList::~JobsList()
     jobs_list.erase(jobs_list.begin()+i);
     delete temp; 
   }
+  for (size_t i = 0; i < killed_jobs.size(); i++)
+  {
+    delete killed_jobs[i];
+  }
 }
 
 void JobsList::addJob(Command *cmd, bool isStopped)
 {
-  removeFinishedJobs();
   JobsList::JobEntry* new_job = new JobsList::JobEntry();
-  pid_t curr_job_id = getMaxJobID()+1;
-
-  new_job->setJobID(curr_job_id); 
   new_job->setProccessId(cmd->getPid());
-  new_job->setCmd(cmd->getCmdLine());
+  new_job->setCmd(cmd->getJobLine());
   time_t init_time;
   time(&init_time); 
   new_job->setInitTime(init_time);
+  // a command stopped by ctrl-Z keeps the time it was started at
+  new_job->setStartTime(cmd->getStartTime() > 0 ? cmd->getStartTime() : _monotonicSeconds());
   new_job->setIsStopped(isStopped);
   new_job->setIsFinished(false);
+  if (cmd->getPid() > 0) // not a built-in
+  {
+    new_job->setPidFd(cmd->takePidFd());
+  }
+
+  // listed while the finished sons are reaped, its own son may already be one of them
+  new_job->setJobID(getMaxJobID()+1);
+  jobs_list.push_back(new_job);
+  removeFinishedJobs();
+  std::vector<JobEntry*>::iterator listed = std::find(jobs_list.begin(), jobs_list.end(), new_job);
+  if (listed == jobs_list.end()) // done already, it is in the history
+    return;
+  jobs_list.erase(listed);
+  pid_t curr_job_id = getMaxJobID()+1; // the ids of the jobs reaped just now are free again
+  new_job->setJobID(curr_job_id);
 
   // insert to vector
   if (jobs_list.empty()){
@@ -986,50 +5859,337 @@ void JobsList::addJob(Command *cmd, bool isStopped)
     }
     jobs_list.insert(it, new_job); 
   }  
+  SmallShell::getInstance().getTracer().instant("job add", "job", curr_job_id, new_job->getCmd().c_str());
+}
+
+void JobsList::addBuiltInJob(Command *cmd, ThreadPool* pool)
+{
+  std::shared_ptr<BuiltInTask> task(new BuiltInTask(cmd));
+  cmd->setPid(-1); // runs on a thread of the smash, there is no process of its own
+  addJob(cmd);
+  getJobById(getMaxJobID())->setTask(task);
+  pool->submit([task]() { task->run(); });
+}
+
+// quit kill: every job's process group gets SIGTERM (and SIGCONT, so stopped ones see it) at once,
+// built-ins are cancelled, and one loop reaps them all, sleeping on an epoll of their pidfds.
+// what is still running at the deadline gets SIGKILL and one more deadline, so the whole
+// shutdown takes at most twice SHUTDOWN_GRACE however many jobs there are
+void JobsList::killAllJobs()
+{
+  double start = _monotonicSeconds();
+  std::cout << "smash: sending SIGTERM signal to " << jobs_list.size()  << " jobs:" << std::endl;
+  struct Shutdown
+  {
+    int job_id;
+    pid_t pid;
+    std::string cmd;
+    bool is_built_in;
+  };
+  std::vector<Shutdown> targets;
+  std::map<pid_t, int> outcome; // pid -> wait status
+  std::set<pid_t> killed;      // got SIGKILL at the deadline
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  bool polling = epoll_fd == -1; // jobs without a pidfd are looked at every 10ms instead
+  for (size_t i = 0; i < jobs_list.size(); i++)
+  {
+    JobEntry* job = jobs_list[i];
+    Shutdown target = {job->getJobID(), job->getProccessId(), job->getCmd(), job->isBuiltIn()};
+    targets.push_back(target);
+    if (job->isBuiltIn())
+    {
+      job->getTask()->cancel();
+      continue;
+    }
+    if (job->signal(0) == 0) // the group id is still the job's while its leader is not reaped
+    {
+      kill(-job->getProccessId(), SIGTERM);
+      kill(-job->getProccessId(), SIGCONT);
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = job->getJobID();
+    if (epoll_fd != -1 && (job->getPidFd() == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, job->getPidFd(), &event) == -1))
+      polling = true;
+  }
+
+  double deadline = start + SHUTDOWN_GRACE;
+  bool escalated = false;
+  while (true)
+  {
+    int status;
+    struct rusage usage;
+    pid_t p;
+    while ((p = wait4(-1, &status, WNOHANG, &usage)) > 0)
+    {
+      outcome[p] = status;
+      reapedProccess(p, status, usage); // removes the job, which closes its pidfd
+    }
+    size_t running = 0;
+    for (size_t i = 0; i < jobs_list.size(); i++)
+      running += jobs_list[i]->isBuiltIn() ? 0 : 1;
+    double now = _monotonicSeconds();
+    if (running == 0 || (now >= deadline && escalated))
+      break;
+    if (now >= deadline)
+    {
+      escalated = true;
+      for (size_t i = 0; i < jobs_list.size(); i++)
+      {
+        if (jobs_list[i]->isBuiltIn() || jobs_list[i]->signal(0) == -1)
+          continue;
+        kill(-jobs_list[i]->getProccessId(), SIGKILL);
+        killed.insert(jobs_list[i]->getProccessId());
+      }
+      deadline = now + SHUTDOWN_GRACE;
+      continue;
+    }
+    int timeout_ms = polling ? 10 : (int)std::ceil((deadline - now) * 1000);
+    struct epoll_event events[64];
+    if (epoll_fd == -1)
+      usleep(timeout_ms * 1000);
+    else
+      epoll_wait(epoll_fd, events, 64, timeout_ms);
+  }
+  if (epoll_fd != -1)
+    close(epoll_fd);
+
+  for (size_t i = 0; i < targets.size(); i++)
+  {
+    std::cout << targets[i].pid << ": " << targets[i].cmd << " : ";
+    std::map<pid_t, int>::iterator it = outcome.find(targets[i].pid);
+    if (targets[i].is_built_in)
+      std::cout << "cancelled (thread)";
+    else if (it == outcome.end())
+      std::cout << "still running";
+    else if (WIFSIGNALED(it->second))
+      std::cout << "signal " << WTERMSIG(it->second) << (killed.count(targets[i].pid) ? " after the deadline" : "");
+    else
+      std::cout << "exit " << WEXITSTATUS(it->second);
+    std::cout << std::endl;
+  }
+  std::cout << "smash: " << targets.size() << " jobs shut down in " << std::fixed << std::setprecision(3)
+            << _monotonicSeconds() - start << "s" << std::endl;
+  std::cout.unsetf(std::ios_base::floatfield);
+}
+
+void JobsList::printJobsList(std::ostream& out)
+{
+  removeFinishedJobs();
+
+  for (size_t i=0; i< jobs_list.size(); i++)
+  {
+    time_t print_time; 
+    time(&print_time);
+    out << "[" << jobs_list[i]->getJobID() << "] "   
+    << jobs_list[i]->getCmd() << " : " << jobs_list[i]->getProccessId() << " "
+    << difftime(print_time ,jobs_list[i]->getInitTime()) << " secs"; 
+    if (jobs_list[i]->getIsStopped()){
+       out << " (stopped)";
+    }
+    if (jobs_list[i]->isBuiltIn()){
+       out << " (thread)";
+    }
+    out << endl;   
+  }
+}
+
+static std::string _formatUsage(double wall_time, const struct rusage& usage)
+{
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3) << "real " << wall_time << "s"
+      << " user " << usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 << "s"
+      << " sys " << usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6 << "s"
+      << " maxrss " << usage.ru_maxrss << "kB"
+      << " faults " << usage.ru_minflt << "/" << usage.ru_majflt
+      << " ctxsw " << usage.ru_nvcsw << "/" << usage.ru_nivcsw;
+  return out.str();
+}
+
+// running jobs with their exact wall time, then the finished ones (job id "-" for foreground
+// commands) with what they used: faults are minor/major, ctxsw voluntary/involuntary
+void JobsList::printJobsVerbose(std::ostream& out)
+{
+  removeFinishedJobs();
+  double now = _monotonicSeconds();
+  for (size_t i = 0; i < jobs_list.size(); i++)
+  {
+    JobEntry* job = jobs_list[i];
+    out << "[" << job->getJobID() << "] " << job->getCmd() << " : " << job->getProccessId()
+        << (job->getIsStopped() ? " stopped" : " running") << (job->isBuiltIn() ? " (thread)" : "")
+        << " real " << std::fixed << std::setprecision(3) << now - job->getStartTime() << "s"
+        << (job->isBuiltIn() ? "" : _formatSched(job->getProccessId())) << endl;
+    PerfCounters::Totals perf = getPerfTotals(job->getProccessId());
+    if (perf.counted)
+      out << "    " << PerfCounters::format(perf) << endl;
+  }
+  SmallShell::getInstance().getTimedList().printTimedEntries(out);
+  if (history.empty())
+    return;
+  out << "finished:" << endl;
+  for (size_t i = 0; i < history.size(); i++)
+  {
+    const FinishedJob& job = history[i];
+    out << "[";
+    if (job.job_id > 0)
+      out << job.job_id;
+    else
+      out << "-";
+    out << "] " << job.cmd << " : " << job.pid;
+    if (job.status == -1)
+      out << " done";
+    else if (WIFSIGNALED(job.status))
+      out << " signal " << WTERMSIG(job.status);
+    else
+      out << " exit " << WEXITSTATUS(job.status);
+    out << " " << _formatUsage(job.wall_time, job.usage) << endl;
+    if (job.perf.counted)
+      out << "    " << PerfCounters::format(job.perf) << endl;
+  }
+}
+
+void JobsList::removeFinishedJobs()
+{
+  int status = 0;
+  struct rusage usage;
+  pid_t p = wait4(-1,&status,WNOHANG,&usage);
+  while(p>0) {
+      std::map<pid_t, int>::iterator it = watched.find(p);
+      if (it != watched.end())
+      {
+        it->second = status;
+      }
+      reapedProccess(p, status, usage);
+      p = wait4(-1 , &status, WNOHANG, &usage);
+  }
+  for (int i = jobs_list.size()-1; i>=0; i--)
+  {
+    if (jobs_list[i]->isBuiltIn() && jobs_list[i]->getTask()->isFinished())
+    {
+      std::shared_ptr<BuiltInTask> task = jobs_list[i]->getTask();
+      recordFinished(jobs_list[i]->getJobID(), jobs_list[i]->getCmd(), jobs_list[i]->getProccessId(),
+                     _monotonicSeconds() - task->getWallTime(), -1, task->getUsage());
+      delete jobs_list[i];
+      jobs_list.erase(jobs_list.begin()+i);
+    }
+  }
+}
+
+void JobsList::recordFinished(int job_id, const std::string& cmd, pid_t pid, double start_time, int status, const struct rusage& usage)
+{
+  FinishedJob job;
+  job.job_id = job_id;
+  job.cmd = cmd;
+  job.pid = pid;
+  job.status = status;
+  job.wall_time = (start_time > 0) ? _monotonicSeconds() - start_time : 0;
+  job.usage = usage;
+  job.perf = getPerfTotals(pid); // final: the son is reaped
+  if (sons_usage != nullptr && status != -1 && start_time >= sons_since)
+  {
+    timeradd(&sons_usage->ru_utime, &usage.ru_utime, &sons_usage->ru_utime);
+    timeradd(&sons_usage->ru_stime, &usage.ru_stime, &sons_usage->ru_stime);
+  }
+  perf_counters.erase(pid);
+  history.push_back(job);
+  if (history.size() > HISTORY_SIZE)
+  {
+    history.pop_front();
+  }
+}
+
+void JobsList::reapedProccess(pid_t p, int status, const struct rusage& usage)
+{
+  SmallShell::getInstance().getTimedList().finishTimedEntry(p);
+  JobEntry* job = getJobByPid(p);
+  bool was_killed = false;
+  for (size_t i = 0; job == nullptr && i < killed_jobs.size(); i++)
+  {
+    if (killed_jobs[i]->getProccessId() == p)
+    {
+      job = killed_jobs[i];
+      killed_jobs.erase(killed_jobs.begin() + i);
+      was_killed = true;
+    }
+  }
+  if (job == nullptr) // e.g. a timeout counter or a dag node
+  {
+    perf_counters.erase(p); // nothing records it, its counters are closed here
+    return;
+  }
+  recordFinished(job->getJobID(), job->getCmd(), p, job->getStartTime(), status, usage);
+  Tracer& tracer = SmallShell::getInstance().getTracer();
+  tracer.instant("wait", "pid", p);
+  tracer.complete("process", job->getStartTime() * 1e9, Tracer::now(), job->getCmd().c_str(), p);
+  if (was_killed)
+    delete job;
+  else
+    removeJobByPid(p);
+}
+
+void JobsList::removeKilledJob(pid_t p)
+{
+  for (int i = jobs_list.size()-1; i>=0; i--)
+  {
+    if (!jobs_list[i]->isBuiltIn() && jobs_list[i]->getProccessId() == p)
+    {
+      SmallShell::getInstance().getTracer().instant("job remove", "job", jobs_list[i]->getJobID(), jobs_list[i]->getCmd().c_str());
+      killed_jobs.push_back(jobs_list[i]);
+      jobs_list.erase(jobs_list.begin()+i);
+    }
+  }
+}
+
+void JobsList::attachPerfCounters(pid_t p)
+{
+  std::shared_ptr<PerfCounters> counters(new PerfCounters(p));
+  if (counters->isOpen())
+    perf_counters[p] = counters;
 }
 
-void JobsList::killAllJobs()
+PerfCounters::Totals JobsList::getPerfTotals(pid_t p) const
 {
-  int kill_result;
-  std::cout << "smash: sending SIGKILL signal to " << jobs_list.size()  << " jobs:" << std::endl;
-  for (size_t i=0; i< jobs_list.size(); i++)
+  std::map<pid_t, std::shared_ptr<PerfCounters> >::const_iterator it = perf_counters.find(p);
+  if (it == perf_counters.end())
   {
-    pid_t pid_to_kill = jobs_list[i]->getProccessId();
-    kill_result = kill(pid_to_kill,SIGKILL);
-    if(kill_result == -1)
-    {
-      perror("smash error: kill failed");
-      return;     
-    }
-    std::cout << jobs_list[i]->getProccessId() << ": " << jobs_list[i]->getCmd() << std::endl;
-  }  
+    PerfCounters::Totals none;
+    none.counted = false;
+    return none;
+  }
+  return it->second->read();
 }
 
-void JobsList::printJobsList()
+void JobsList::watchProccess(pid_t p)
 {
-  removeFinishedJobs();
-
-  for (size_t i=0; i< jobs_list.size(); i++)
+  watched[p] = -1;
+  if (getJobByPid(p) != nullptr)
+    return;
+  // reaped while addJob listed it, its status is in the history already
+  for (int i = history.size()-1; i >= 0; i--)
   {
-    time_t print_time; 
-    time(&print_time);
-    std::cout << "[" << jobs_list[i]->getJobID() << "] "   
-    << jobs_list[i]->getCmd() << " : " << jobs_list[i]->getProccessId() << " "
-    << difftime(print_time ,jobs_list[i]->getInitTime()) << " secs"; 
-    if (jobs_list[i]->getIsStopped()){
-       std::cout << " (stopped)";
+    if (history[i].pid == p)
+    {
+      watched[p] = history[i].status;
+      break;
     }
-    std::cout << endl;   
   }
 }
 
-void JobsList::removeFinishedJobs()
+bool JobsList::takeWatchedStatus(pid_t p, int* status)
 {
-  pid_t p = waitpid(-1,nullptr,WNOHANG);
-  while(p>0) {
-      removeJobByPid(p);
-      p = waitpid(-1 , nullptr, WNOHANG);
+  std::map<pid_t, int>::iterator it = watched.find(p);
+  if (it == watched.end() || it->second == -1)
+  {
+    return false;
   }
+  *status = it->second;
+  watched.erase(it);
+  return true;
+}
+
+void JobsList::unwatchProccess(pid_t p)
+{
+  watched.erase(p);
 }
 
 void JobsList::removeJobByPid(pid_t p)
@@ -1037,14 +6197,27 @@ void JobsList::removeJobByPid(pid_t p)
   for (int i = jobs_list.size()-1; i>=0; i--)
   {
     JobEntry* temp;
-    if (jobs_list[i]-> getProccessId()== p){
+    if (!jobs_list[i]->isBuiltIn() && jobs_list[i]-> getProccessId()== p){
       temp = jobs_list[i];
+      SmallShell::getInstance().getTracer().instant("job remove", "job", temp->getJobID(), temp->getCmd().c_str());
       jobs_list.erase(jobs_list.begin()+i);
       delete temp; 
     }
   }
 }
 
+void JobsList::removeJobById(int jobId)
+{
+  for (int i = jobs_list.size()-1; i>=0; i--)
+  {
+    if (jobs_list[i]->getJobID() == jobId){
+      SmallShell::getInstance().getTracer().instant("job remove", "job", jobId, jobs_list[i]->getCmd().c_str());
+      delete jobs_list[i];
+      jobs_list.erase(jobs_list.begin()+i);
+    }
+  }
+}
+
 pid_t JobsList::getMaxJobID()
 {
   if (jobs_list.empty())
@@ -1076,7 +6249,7 @@ JobsList::JobEntry* JobsList::getJobByPid(int job_pid)
 {
   for (size_t i=0; i< jobs_list.size(); i++)
   {
-    if (jobs_list[i]->getProccessId() == job_pid){
+    if (!jobs_list[i]->isBuiltIn() && jobs_list[i]->getProccessId() == job_pid){
       return jobs_list[i];
     }
   }
@@ -1122,19 +6295,16 @@ JobsList::JobEntry* JobsList::getLastStoppedJob(int *jobId) ///changed
 /******************JOBLIST COMMANDS*/
 
 /*TIMEOUT COMMANDS***************/
-TimedList::TimedEntry::TimedEntry(pid_t _pid, pid_t _pid_to_kill, std::string _cmd_to_kill, int _duration, double _running_time) : pid(_pid), pid_to_kill(_pid_to_kill), cmd_to_kill(_cmd_to_kill), duration(_duration), running_time(_running_time) 
-{
-  time(&start_time);
-}
-
-pid_t TimedList::TimedEntry::getPid() const
+TimedList::TimedEntry::TimedEntry(int _id, pid_t _pid_to_kill, std::string _cmd_to_kill, double _duration, double _grace, int _pidfd) :
+  id(_id), has_timer(false), pid_to_kill(_pid_to_kill), cmd_to_kill(_cmd_to_kill), start_time(_monotonicSeconds()),
+  duration(_duration), grace(_grace), running_time(-1), end_time(-1), timed_out(false),
+  pidfd(_pidfd == -1 ? -1 : fcntl(_pidfd, F_DUPFD_CLOEXEC, 3))
 {
-  return pid;
 }
 
-void TimedList::TimedEntry::setPid(pid_t _pid)
+int TimedList::TimedEntry::getId() const
 {
-  pid = _pid; 
+  return id;
 }
 
 pid_t TimedList::TimedEntry::getPidToKill() const
@@ -1142,27 +6312,22 @@ pid_t TimedList::TimedEntry::getPidToKill() const
   return pid_to_kill; 
 }
 
-void TimedList::TimedEntry::setPidToKill(pid_t _pid_to_kill)
-{
-  pid_to_kill = _pid_to_kill;
-}
-
 std::string TimedList::TimedEntry::getCmdToKill() const
 {
   return cmd_to_kill;
 }
 
-void TimedList::TimedEntry::setCmdToKill(std::string _cmd_to_kill)
+double TimedList::TimedEntry::getDuration() const
 {
-  cmd_to_kill = _cmd_to_kill; 
+  return duration; 
 }
 
-int TimedList::TimedEntry::getDuration() const
+double TimedList::TimedEntry::getGrace() const
 {
-  return duration; 
+  return grace;
 }
 
-time_t TimedList::TimedEntry::getStartTime() const
+double TimedList::TimedEntry::getStartTime() const
 {
   return start_time; 
 }
@@ -1171,58 +6336,222 @@ double TimedList::TimedEntry::getRunningTime() const
 {
   return running_time;
 }
+
 void TimedList::TimedEntry::setRunningTime(double _running_time)
 {
   running_time = _running_time;
 }
 
-void TimedList::addTimedEntry(pid_t _pid, pid_t _pid_to_kill, std::string _cmd, int _duration)
+double TimedList::TimedEntry::getEndTime() const
 {
-  TimedEntry entry(_pid, _pid_to_kill, _cmd, _duration); 
-  timedList.push_front(entry);
+  return end_time;
 }
 
-void TimedList::removeTimedEntry (pid_t _pid)
+void TimedList::TimedEntry::noteEnded()
 {
-  list<TimedList::TimedEntry>::iterator itr;
-  
-  for (itr = timedList.begin();  itr != timedList.end(); itr++)
-  { 
-    if (itr->getPid() == _pid){
-      timedList.erase(itr);
-      return;
+  if (end_time >= 0 || pidfd == -1)
+    return;
+  struct pollfd exited = {pidfd, POLLIN, 0}; // a pidfd is readable once its process exited
+  if (poll(&exited, 1, 0) == 1)
+    end_time = _monotonicSeconds();
+}
 
-    }
+bool TimedList::TimedEntry::isTimedOut() const
+{
+  return timed_out;
+}
+
+void TimedList::TimedEntry::setTimedOut()
+{
+  timed_out = true;
+}
+
+bool TimedList::TimedEntry::hasTimer() const
+{
+  return has_timer;
+}
+
+bool TimedList::TimedEntry::arm(double seconds)
+{
+  if (!has_timer)
+  {
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGALRM;
+    event.sigev_value.sival_int = id;
+    if (timer_create(CLOCK_MONOTONIC, &event, &timer) == -1)
+      return false;
+    has_timer = true;
   }
+  struct itimerspec when;
+  memset(&when, 0, sizeof(when));
+  when.it_value.tv_sec = (time_t)seconds;
+  when.it_value.tv_nsec = (long)((seconds - (time_t)seconds) * 1e9);
+  if (when.it_value.tv_sec == 0 && when.it_value.tv_nsec == 0)
+    when.it_value.tv_nsec = 1; // zero would disarm it
+  return timer_settime(timer, 0, &when, nullptr) == 0;
 }
 
-TimedList::TimedEntry& TimedList::getTimedEntryByPid(pid_t pid)
+void TimedList::TimedEntry::disarm()
 {
-  list<TimedList::TimedEntry>::iterator itr;
-  
-  for (itr = timedList.begin();  itr != timedList.end(); itr++)
+  if (has_timer)
+    timer_delete(timer);
+  has_timer = false;
+}
+
+int TimedList::TimedEntry::signalGroup(int sig) const
+{
+  // the group id can not be reused while its leader is not reaped - the pidfd tells
+  if (_sendSignal(pidfd, pid_to_kill, 0) == -1)
+    return -1;
+  return kill(-pid_to_kill, sig);
+}
+
+void TimedList::TimedEntry::closePidFd()
+{
+  if (pidfd != -1)
+    close(pidfd);
+  pidfd = -1;
+}
+
+TimedList::TimedList() : next_id(1) {}
+
+// the entries are changed by the SIGALRM and SIGCHLD handlers too, so they are held off meanwhile
+static void _blockTimerSignals(sigset_t* old)
+{
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGALRM);
+  sigaddset(&signals, SIGCHLD);
+  pthread_sigmask(SIG_BLOCK, &signals, old);
+}
+
+TimedList::TimedEntry* TimedList::addTimedEntry(pid_t _pid_to_kill, std::string _cmd, double duration, double grace, int pidfd)
+{
+  sigset_t old;
+  _blockTimerSignals(&old);
+  timedList.push_front(TimedEntry(next_id++, _pid_to_kill, _cmd, duration, grace, pidfd));
+  TimedEntry* entry = &timedList.front();
+  if (!entry->arm(duration))
+  {
+    entry->closePidFd();
+    timedList.pop_front();
+    entry = nullptr;
+  }
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+  return entry;
+}
+
+TimedList::TimedEntry* TimedList::getTimedEntryById(int id)
+{
+  for (list<TimedEntry>::iterator itr = timedList.begin(); itr != timedList.end(); itr++)
   { 
-    if (itr->getPid() == pid)
-    {
-      return *itr; 
-    }
+    if (itr->getId() == id)
+      return &*itr;
+  }
+  return nullptr;
+}
+
+void TimedList::finishTimedEntry(pid_t _pid_to_kill)
+{
+  sigset_t old;
+  _blockTimerSignals(&old);
+  for (list<TimedEntry>::iterator itr = timedList.begin(); itr != timedList.end(); itr++)
+  { 
+    if (itr->getPidToKill() != _pid_to_kill || itr->getRunningTime() >= 0)
+      continue;
+    itr->noteEnded(); // in case no SIGCHLD came (or none was handled) since it exited
+    // without a pidfd the exit can not be told apart from the reap
+    double end = (itr->getEndTime() >= 0) ? itr->getEndTime() : _monotonicSeconds();
+    itr->setRunningTime(end - itr->getStartTime());
+    itr->closePidFd();
+    // after SIGTERM the SIGKILL is still due to what is left of the group, if anything is
+    if (!itr->isTimedOut() || kill(-_pid_to_kill, 0) == -1)
+      itr->disarm();
+    break;
+  }
+  // forget the oldest finished entries
+  size_t finished = 0;
+  for (list<TimedEntry>::iterator itr = timedList.begin(); itr != timedList.end();)
+  {
+    if (itr->getRunningTime() >= 0 && !itr->hasTimer() && ++finished > FINISHED_SIZE)
+      itr = timedList.erase(itr);
+    else
+      itr++;
+  }
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+}
+
+void TimedList::noteEnded()
+{
+  for (list<TimedEntry>::iterator itr = timedList.begin(); itr != timedList.end(); itr++)
+  {
+    if (itr->getRunningTime() < 0)
+      itr->noteEnded();
+  }
+}
+
+void TimedList::expire(int id)
+{
+  TimedEntry* entry = getTimedEntryById(id);
+  if (entry == nullptr)
+    return;
+  if (entry->getRunningTime() >= 0) // finished after SIGTERM, the rest of its group still gets SIGKILL
+  {
+    kill(-entry->getPidToKill(), SIGKILL);
+    entry->disarm();
+    return;
+  }
+  if (entry->isTimedOut())
+  {
+    if (entry->signalGroup(SIGKILL) == -1 && errno != ESRCH)
+      perror("smash error: kill failed");
+    entry->disarm();
+    return;
+  }
+  if (entry->signalGroup(entry->getGrace() > 0 ? SIGTERM : SIGKILL) == -1)
+  {
+    if (errno != ESRCH)
+      perror("smash error: kill failed");
+    return;
+  }
+  entry->setTimedOut();
+  std::cout << "smash: " << entry->getCmdToKill() << " timed out!" << std::endl;
+  if (entry->getGrace() > 0 && !entry->arm(entry->getGrace()))
+  {
+    perror("smash error: timer_settime failed");
   }
-  return *itr; // wont get here
 }
 
-bool TimedList::isTimedOut(pid_t _pid)
+// for jobs -v: the budget next to the time the command actually took, known once it exited
+// (before the smash reaped it too, for a background command)
+void TimedList::printTimedEntries(std::ostream& out)
 {
-  TimedEntry& entry = getTimedEntryByPid(_pid);
-  double running_time = difftime(time(nullptr),entry.getStartTime());
-  cout << running_time << endl;
-  return (running_time <= entry.getDuration());
+  if (timedList.empty())
+    return;
+  out << "timeouts:" << endl;
+  for (list<TimedEntry>::reverse_iterator itr = timedList.rbegin(); itr != timedList.rend(); itr++)
+  {
+    out << itr->getCmdToKill() << " : " << itr->getPidToKill() << std::fixed << std::setprecision(3)
+        << " budget " << itr->getDuration() << "s";
+    if (itr->getRunningTime() >= 0)
+      out << " took " << itr->getRunningTime() << "s";
+    else if (itr->getEndTime() >= 0)
+      out << " took " << itr->getEndTime() - itr->getStartTime() << "s";
+    else
+      out << " running " << _monotonicSeconds() - itr->getStartTime() << "s";
+    out << (itr->isTimedOut() ? " timed out" : "") << endl;
+  }
 }
 /******************TIMEOUT COMMANDS*/
 
 /*SMALLSHELL COMMANDS***************/
-SmallShell::SmallShell() : current_prompt("smash> "), lastwd(nullptr), s_jobs(nullptr), s_quit(false), s_is_piped(false), s_timedlist()
+SmallShell::SmallShell() : current_prompt("smash> "), lastwd(nullptr), s_jobs(nullptr), s_quit(false), s_is_piped(false), s_timedlist(), s_pool(nullptr), s_fg_built_in(nullptr), s_exec_timing(false), s_exec_latency(0), s_exec_count(0), s_interrupts(0), s_stat_kind(STAT_BUILT_IN), s_wait_end(0), s_perf(false)
 {
   s_jobs = new JobsList();
+  const char* perf = getenv("SMASH_PERF");
+  s_perf = perf != nullptr && strcmp(perf, "1") == 0;
 }
 
 SmallShell::~SmallShell()
@@ -1231,6 +6560,15 @@ SmallShell::~SmallShell()
   {
     free(lastwd);
   }
+  if (s_pool != nullptr) // stop the built-ins still running in the background before joining them
+  {
+    for (size_t i = 0; i < s_jobs->jobs_list.size(); i++)
+    {
+      if (s_jobs->jobs_list[i]->isBuiltIn())
+        s_jobs->jobs_list[i]->getTask()->cancel();
+    }
+    delete s_pool;
+  }
   if(s_jobs != nullptr)
   {
     delete s_jobs;
@@ -1245,26 +6583,33 @@ Command *SmallShell::CreateCommand(const char *cmd_line)
   string cmd_s = _trim(string(cmd_line));
   string firstWord = cmd_s.substr(0, cmd_s.find_first_of(" \n"));
 
-  size_t pos = cmd_s.find(">>");
-  bool append=false;
-  bool redirected = false;
-  if(pos != string::npos)
+  if (firstWord.compare("exec") == 0) // its N>file specs are not redirections of a command
   {
-    redirected = true;
-    append = true;
+    return new ExecCommand(cmd_line);
   }
-  else{
-    pos = cmd_s.find(">");  
-    if (pos != string::npos)
-    { 
-    redirected = true;
-    }  
+  if (firstWord.compare("time") == 0) // wraps the whole line, pipes and redirections included
+  {
+    return new TimeCommand(cmd_line);
+  }
+  if (firstWord.compare("bench") == 0)
+  {
+    return new BenchCommand(cmd_line);
+  }
+  if (firstWord.compare("timeout") == 0) // the son runs the whole line, pipes and redirections in its own process group
+  {
+    return new ExternalCommand(cmd_line, s_jobs);
   }
-  if  (redirected == true){
-    return new RedirectionCommand(cmd_line, append, pos); 
+  if (firstWord.compare("affinity") == 0 || firstWord.compare("nice") == 0 || firstWord.compare("sched") == 0)
+  {
+    return new SchedControlCommand(cmd_line, s_jobs);
+  }
+
+  if (cmd_s.find_first_of("<>") != string::npos)
+  {
+    return new RedirectionCommand(cmd_line);
   }
 
-  pos = cmd_s.find(" | ");
+  size_t pos = cmd_s.find(" | ");
   bool ch_stdout = false; 
   bool piped = false; 
   if(pos != string::npos)
@@ -1280,7 +6625,6 @@ Command *SmallShell::CreateCommand(const char *cmd_line)
     }  
   }
   if  (piped == true){
-    s_is_piped = true;
     return new PipeCommand(cmd_line, ch_stdout, pos); 
   }
 
@@ -1328,16 +6672,154 @@ Command *SmallShell::CreateCommand(const char *cmd_line)
   {
     return new TouchCommand(cmd_line);
   }
+  if (firstWord.compare("cat") == 0 || firstWord.compare("cat&") == 0)
+  {
+    return new CatCommand(cmd_line);
+  }
+  if (firstWord.compare("tee") == 0 || firstWord.compare("tee&") == 0)
+  {
+    return new TeeCommand(cmd_line);
+  }
+  if (firstWord.compare("wc") == 0 || firstWord.compare("wc&") == 0)
+  {
+    return new WcCommand(cmd_line);
+  }
+  if (firstWord.compare("search") == 0 || firstWord.compare("search&") == 0)
+  {
+    return new SearchCommand(cmd_line);
+  }
+  if (firstWord.compare("walk") == 0 || firstWord.compare("walk&") == 0)
+  {
+    return new WalkCommand(cmd_line);
+  }
+  if (firstWord.compare("stats") == 0)
+  {
+    return new StatsCommand(cmd_line);
+  }
+  if (firstWord.compare("trace") == 0)
+  {
+    return new TraceCommand(cmd_line);
+  }
+  if (firstWord.compare("wait") == 0)
+  {
+    return new WaitCommand(cmd_line, s_jobs);
+  }
+  if (firstWord.compare("throttle") == 0)
+  {
+    return new ThrottleCommand(cmd_line);
+  }
+  if (firstWord.compare("perfstat") == 0)
+  {
+    return new PerfStatCommand(cmd_line);
+  }
+  if (firstWord.compare("dag") == 0 || firstWord.compare("dag&") == 0)
+  {
+    return new DagCommand(cmd_line, s_jobs);
+  }
   else {
     return new ExternalCommand(cmd_line, s_jobs);
   }
   return nullptr;
 }
 
-void SmallShell::executeCommand(const char *cmd_line)
+static int _statKind(Command* cmd)
+{
+  if (dynamic_cast<RedirectionCommand*>(cmd) != nullptr)
+    return STAT_REDIRECT;
+  if (dynamic_cast<PipeCommand*>(cmd) != nullptr)
+    return STAT_PIPE;
+  if (dynamic_cast<ExternalCommand*>(cmd) != nullptr)
+    return STAT_EXTERNAL;
+  return STAT_BUILT_IN;
+}
+
+// built-ins that deal with the jobs themselves (and wrappers, whose command line decides)
+static bool _isJobControl(Command* cmd)
+{
+  return dynamic_cast<JobsCommand*>(cmd) != nullptr || dynamic_cast<ForegroundCommand*>(cmd) != nullptr ||
+         dynamic_cast<BackgroundCommand*>(cmd) != nullptr || dynamic_cast<KillCommand*>(cmd) != nullptr ||
+         dynamic_cast<WaitCommand*>(cmd) != nullptr || dynamic_cast<QuitCommand*>(cmd) != nullptr ||
+         dynamic_cast<DagCommand*>(cmd) != nullptr || dynamic_cast<SchedControlCommand*>(cmd) != nullptr;
+}
+
+// the process groups of the background jobs that are running (not threads, not stopped by the user)
+// a job stopped with kill -19 / -20 is not marked stopped in the list, /proc tells
+static bool _isProcessStopped(pid_t pid)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+  char buf[512];
+  ssize_t len = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (len <= 0)
+    return false;
+  buf[len] = '\0';
+  char* fields = strrchr(buf, ')'); // the command name may hold spaces and parentheses
+  return fields != nullptr && fields[1] == ' ' && (fields[2] == 'T' || fields[2] == 't');
+}
+
+// the running (not stopped by the user) background jobs' process groups
+static std::vector<Throttler::Group> _backgroundGroups(JobsList* jobs)
+{
+  std::vector<Throttler::Group> groups;
+  for (size_t i = 0; i < jobs->jobs_list.size(); i++)
+  {
+    JobsList::JobEntry* job = jobs->jobs_list[i];
+    if (job->isBuiltIn() || job->getIsStopped() || _isProcessStopped(job->getProccessId()))
+      continue;
+    Throttler::Group group = {job->getProccessId(), job->getPidFd()};
+    groups.push_back(group);
+  }
+  return groups;
+}
+
+void SmallShell::executeCommand(const char *cmd_line, int out_fd)
+{
+  double start = _monotonicSeconds();
+  Command* cmd = CreateCommand(cmd_line);
+  if (out_fd != STDOUT_FILENO)
+    cmd->setOutFd(out_fd);
+  double parsed = _monotonicSeconds();
+  int outer_kind = s_stat_kind; // time / bench run command lines from inside a command line
+  double outer_wait_end = s_wait_end;
+  s_stat_kind = _statKind(cmd);
+  s_wait_end = 0;
+  recordStat(STAT_PARSE, parsed - start);
+  s_tracer.complete("parse", start * 1e9, parsed * 1e9, cmd_line);
+
+  bool is_bg = _isBackgroundComamnd(cmd_line);
+  bool throttling = !is_bg && !_isJobControl(cmd) && s_throttler.getMode() != Throttler::OFF &&
+                    s_throttler.begin(_backgroundGroups(s_jobs));
+  runCommand(cmd, is_bg);
+  if (throttling) // full speed again before the prompt
+    s_throttler.end();
+
+  double end = _monotonicSeconds();
+  s_tracer.complete("command", start * 1e9, end * 1e9, cmd_line);
+  if (s_wait_end > 0)
+    recordStat(STAT_REAP, end - s_wait_end);
+  recordStat(STAT_TOTAL, end - start);
+  s_stat_kind = outer_kind;
+  s_wait_end = outer_wait_end;
+}
+
+void SmallShell::runCommand(Command *cmd, bool is_bg)
 {
-  Command *cmd = CreateCommand(cmd_line);
+  BuiltInCommand *built_in = dynamic_cast<BuiltInCommand*>(cmd);
+  if (built_in != nullptr && built_in->canRunInBackground() && is_bg)
+  {
+    s_jobs->addBuiltInJob(cmd, getThreadPool());
+    return;
+  }
+  if (built_in != nullptr)
+  {
+    s_fg_built_in = cmd;
+  }
   cmd->execute();
+  s_fg_built_in = nullptr;
   delete cmd;
 }
 
@@ -1388,11 +6870,143 @@ JobsList* SmallShell::getJobsList()
   return s_jobs;
 }
 
+DirCache& SmallShell::getDirCache()
+{
+  return s_dir_cache;
+}
+
 TimedList& SmallShell::getTimedList()
 {
   return s_timedlist; 
 }
 
+void SmallShell::forgetThreadPool()
+{
+  s_pool = nullptr; // its threads were not copied into the son, so it is left as is, never joined
+}
+
+ThreadPool* SmallShell::getThreadPool()
+{
+  if (s_pool == nullptr)
+  {
+    int num_of_threads = std::max(4, (int)sysconf(_SC_NPROCESSORS_ONLN));
+    s_pool = new ThreadPool(num_of_threads);
+  }
+  return s_pool;
+}
+
+Command* SmallShell::getForegroundBuiltIn() const
+{
+  return s_fg_built_in;
+}
+
+void SmallShell::setForegroundBuiltIn(Command* command)
+{
+  s_fg_built_in = command;
+}
+
+int SmallShell::getFdSlot(int slot) const
+{
+  std::map<int, int>::const_iterator it = s_fd_slots.find(slot);
+  return (it == s_fd_slots.end()) ? -1 : it->second;
+}
+
+void SmallShell::setFdSlot(int slot, int fd)
+{
+  closeFdSlot(slot);
+  s_fd_slots[slot] = fd;
+}
+
+bool SmallShell::closeFdSlot(int slot)
+{
+  std::map<int, int>::iterator it = s_fd_slots.find(slot);
+  if (it == s_fd_slots.end())
+    return false;
+  if (close(it->second) == -1)
+  {
+    perror("smash error: close failed");
+  }
+  s_fd_slots.erase(it);
+  return true;
+}
+
+bool SmallShell::isExecTiming() const
+{
+  return s_exec_timing;
+}
+
+void SmallShell::setExecTiming(bool exec_timing)
+{
+  s_exec_timing = exec_timing;
+}
+
+void SmallShell::addExecLatency(double latency)
+{
+  s_exec_latency += latency;
+  s_exec_count++;
+}
+
+double SmallShell::getExecLatency(int* count) const
+{
+  *count = s_exec_count;
+  return s_exec_latency;
+}
+
+void SmallShell::recordStat(int phase, double seconds)
+{
+  s_stats[s_stat_kind][phase].record(seconds > 0 ? (unsigned long long)(seconds * 1e9) : 0);
+}
+
+void SmallShell::setWaitEnd(double wait_end)
+{
+  s_wait_end = wait_end;
+}
+
+LatencyHistogram& SmallShell::getStat(int kind, int phase)
+{
+  return s_stats[kind][phase];
+}
+
+Tracer& SmallShell::getTracer()
+{
+  return s_tracer;
+}
+
+Throttler& SmallShell::getThrottler()
+{
+  return s_throttler;
+}
+
+const SchedSettings& SmallShell::getLaunchSched() const
+{
+  return s_launch_sched;
+}
+
+void SmallShell::setLaunchSched(const SchedSettings& sched)
+{
+  s_launch_sched = sched;
+}
+
+bool SmallShell::isPerfOn() const
+{
+  return s_perf;
+}
+
+void SmallShell::setPerf(bool perf)
+{
+  s_perf = perf;
+}
+
+void SmallShell::addInterrupt()
+{
+  s_interrupts = s_interrupts + 1;
+}
+
+int SmallShell::getInterrupts() const
+{
+  return s_interrupts;
+}
+
 bool SmallShell::isPiped()
 {
   return s_is_piped;
@@ -9,6 +9,21 @@
 #include <fcntl.h>
 #include <utime.h>
 #include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <iostream>
+#include <regex.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/resource.h>
 
 
 #define COMMAND_ARGS_MAX_LENGTH (200)
@@ -26,6 +41,15 @@ protected:
   int c_num_of_args;
   bool isANumber(const char* str);
   bool is_built_in;
+  std::atomic<bool> c_cancelled; // set by kill / ctrl-C, long running built-ins poll it
+  int c_in_fd;  // where the command reads / writes its data - the standard fds unless
+  int c_out_fd; // it is a pipe stage (built-ins use them in-process, external
+  int c_err_fd; // commands get them dup2'ed in the son before exec)
+  bool c_owns_fds;
+  double c_start_time; // CLOCK_MONOTONIC seconds when the command was started (0: not started)
+  std::string c_job_line; // shown in the jobs list instead of c_cmd_line when set
+  int c_pidfd; // of the son started for the command, -1 if none. a job takes it over
+  bool writeOut(const std::string& str);
 
 public:
   Command(const char *cmd_line, bool is_built_in = false);  
@@ -34,6 +58,21 @@ public:
   virtual pid_t getPid() const; 
   virtual void setPid(pid_t pid);
   virtual std::string getCmdLine(); 
+  std::string getJobLine(); // the line the user typed, e.g. with the redirections of the command
+  void setJobLine(const std::string& job_line);
+  void setPidFd(int pidfd); // closes the previous one
+  int takePidFd(); // the caller owns it from now on
+  void cancel();
+  bool isCancelled() const;
+  int getInFd() const;
+  void setInFd(int fd);
+  int getOutFd() const;
+  void setOutFd(int fd);
+  int getErrFd() const;
+  void setErrFd(int fd);
+  void setOwnsFds(bool owns_fds); // close the non standard in / out / err fds in the destructor
+  double getStartTime() const;
+  void setStartTime(double start_time);
 };
 
 class BuiltInCommand : public Command
@@ -41,6 +80,57 @@ class BuiltInCommand : public Command
 public:
   BuiltInCommand(const char *cmd_line);
   virtual ~BuiltInCommand() = default;
+  // built-ins returning true are run on the smash thread pool when given '&', the rest ignore it
+  virtual bool canRunInBackground() const;
+  // built-ins that only produce/consume data (no change of the smash state) run as an
+  // in-process pipe stage, the others are run by a forked smash like before
+  virtual bool canRunInPipe() const;
+};
+
+// fixed size pool of worker threads, the workers never handle signals (the main thread does)
+class ThreadPool
+{
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()> > tasks;
+  std::mutex lock;
+  std::condition_variable cond;
+  bool stopping;
+  void workerLoop();
+public:
+  explicit ThreadPool(int num_of_threads);
+  ~ThreadPool(); // finishes queued tasks and joins the workers
+  ThreadPool(ThreadPool const &) = delete;
+  void operator=(ThreadPool const &) = delete;
+  void submit(std::function<void()> task);
+  // runs func(0) .. func(count-1) on the pool. the caller takes part too, so it only waits for
+  // items already taken by workers and never for tasks stuck in the queue
+  void parallelFor(size_t count, std::function<void(size_t)> func);
+  size_t size() const;
+};
+
+// a built-in command that was given '&' and runs on the thread pool instead of a forked son
+class BuiltInTask
+{
+  Command* cmd;
+  std::atomic<bool> finished;
+  int done_fd;          // eventfd, readable once finished (so wait can epoll on it)
+  double wall_time;     // run time of the thread (valid once finished)
+  struct rusage usage;  // RUSAGE_THREAD of the run (ru_maxrss is the whole smash's)
+  std::mutex lock;
+  std::condition_variable cond;
+public:
+  explicit BuiltInTask(Command* cmd);
+  ~BuiltInTask(); // deletes cmd
+  BuiltInTask(BuiltInTask const &) = delete;
+  void operator=(BuiltInTask const &) = delete;
+  void run();
+  void cancel();
+  bool isFinished() const;
+  void waitFinished();
+  int getDoneFd() const;
+  Command* getCommand() const;
+  double getWallTime() const;
+  const struct rusage& getUsage() const;
 };
 
 class ExternalCommand : public Command
@@ -50,6 +140,10 @@ public:
   ExternalCommand(const char *cmd_line, JobsList* jobs);
   virtual ~ExternalCommand() = default;
   void execute() override; 
+  pid_t spawn(); // forks and execs with the command's fds, no waiting or job bookkeeping
+  // in the son: set up fds and exec - argv directly if it is not empty, else bash. never returns
+  void execChild(char* ex_cmd_line, const std::vector<std::string>& argv);
+  bool isTimeout() const;
 };
 
 class PipeCommand : public Command
@@ -62,14 +156,24 @@ public:
   void execute() override;
 };
 
-// redirect output of first command to give out put file after " < " or " << " ( spaces are necessary for identification of command)
-// we assume redirected commands are ignoring &(background sign), and cannot be killed or stoped
+// a command with redirections: [N]>file [N]>>file &>file &>>file <file <<<string [N]>&M <&N
+// (N, M are 0-2, or an exec slot on the right side). the files are opened by the smash and handed
+// to the command as its fds - external commands get them dup2'ed in the son between fork and
+// exec, data built-ins use them directly - so the smash's own fds are never touched for them
 class RedirectionCommand : public Command
 {
-  bool append;
-  size_t pos; 
+  struct Redirect
+  {
+    int fd;             // 0, 1, 2, or -1 for both 1 and 2 (&>)
+    std::string op;     // "<" "<&" "<<<" ">" ">>" ">&"
+    std::string target; // file, fd / slot number or here-string
+  };
+  std::string inner_cmd_line; // the command line without its redirections
+  std::vector<Redirect> redirects;
+  bool parse();
+  bool openRedirects(int fds[3]);
 public:
-  explicit RedirectionCommand(const char *cmd_line, bool _append, size_t pos);
+  explicit RedirectionCommand(const char *cmd_line);
   virtual ~RedirectionCommand() {}
   void execute() override;
 };
@@ -87,6 +191,7 @@ class GetCurrDirCommand : public BuiltInCommand
 public:
   GetCurrDirCommand(const char *cmd_line);
   virtual ~GetCurrDirCommand() = default;
+  bool canRunInPipe() const override;
   void execute() override;
 };
 
@@ -95,6 +200,7 @@ class ShowPidCommand : public BuiltInCommand
 public:
   ShowPidCommand(const char *cmd_line);
   virtual ~ShowPidCommand() = default;
+  bool canRunInPipe() const override;
   void execute() override;
 };
 
@@ -108,6 +214,65 @@ class QuitCommand : public BuiltInCommand
   void execute() override;
 };
 
+// exec N>file, N>>file, N<file, N>&- : opens / closes the persistent fd slot N (3-9) of the
+// smash, "cmd >&N" then writes into it without opening the file again
+class ExecCommand : public BuiltInCommand
+{
+public:
+  ExecCommand(const char *cmd_line);
+  virtual ~ExecCommand() = default;
+  void execute() override;
+};
+
+// time <command line>: runs any command line in the foreground and prints its wall time, the cpu
+// time of the smash and its sons, and how long the sons took from fork to exec
+class TimeCommand : public BuiltInCommand
+{
+public:
+  TimeCommand(const char *cmd_line);
+  virtual ~TimeCommand() = default;
+  void execute() override;
+};
+
+// bench [-n runs] [-w warmup] [-q] <command line>: runs a command line again and again through
+// executeCommand and prints the latency percentiles and the throughput. -q gives the runs' commands
+// /dev/null as their out fd, the smash's own stdout stays as it is
+class BenchCommand : public BuiltInCommand
+{
+public:
+  BenchCommand(const char *cmd_line);
+  virtual ~BenchCommand() = default;
+  void execute() override;
+};
+
+// cpu affinity, nice and scheduling policy given by the affinity / nice / sched built-ins
+struct SchedSettings
+{
+  bool has_cpus;
+  cpu_set_t cpus;
+  bool has_nice;
+  int nice;
+  int policy;   // SCHED_*, -1: unchanged
+  int priority; // for SCHED_FIFO / SCHED_RR
+  SchedSettings();
+  bool isSet() const;
+  void merge(const SchedSettings& other); // what other sets overrides
+  bool apply(pid_t tid) const; // 0: the calling thread. perror and false on failure
+};
+
+// affinity cpulist cmd / nice [-n N] cmd / sched policy [priority] cmd: runs the command line with
+// the setting applied by its sons before exec. with -j job-id instead of a command, applies it
+// to every thread of the running job's process group
+class SchedControlCommand : public BuiltInCommand
+{
+  JobsList* c_jobs;
+  bool parseSetting(std::string& rest, SchedSettings& settings);
+public:
+  SchedControlCommand(const char *cmd_line, JobsList* jobs);
+  virtual ~SchedControlCommand() = default;
+  void execute() override;
+};
+
 class ChangePromptCommand : public BuiltInCommand
 {
 public:
@@ -116,6 +281,47 @@ public:
   void execute() override;
 };
 
+// perf_event_open counters of a son (SMASH_PERF=1 or perfstat on). the smash opens them between
+// the son's fork and its exec with enable_on_exec, and they are inherited by the son's own sons.
+// when the kernel refuses the hardware counters only the software ones are kept
+class PerfCounters
+{
+public:
+  enum Counter { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, TASK_CLOCK, CONTEXT_SWITCHES, PAGE_FAULTS, COUNTERS };
+  struct Totals
+  {
+    bool counted;
+    long long values[COUNTERS]; // -1: not counted. task-clock is in ns
+  };
+private:
+  int fds[COUNTERS];
+public:
+  explicit PerfCounters(pid_t pid); // 0: the calling process
+  ~PerfCounters();
+  PerfCounters(PerfCounters const &) = delete;
+  void operator=(PerfCounters const &) = delete;
+  bool isOpen() const;
+  bool hasHardware() const;
+  Totals read() const; // scaled up when the kernel multiplexed a counter
+  static std::string format(const Totals& totals);
+};
+
+// perfstat [on|off]
+class PerfStatCommand : public BuiltInCommand
+{
+public:
+  PerfStatCommand(const char *cmd_line);
+  virtual ~PerfStatCommand() = default;
+  void execute() override;
+};
+
+// pidfd_open(pid), -1 on error. signals sent through a pidfd of an unreaped son can never reach
+// another process that got its pid after it was reaped
+int _pidfdOpen(pid_t pid);
+// fork, and in the parent the son's pidfd (-1 on error) before any handler of the smash can reap it
+pid_t _forkWithPidFd(int* pidfd);
+int _sendSignal(int pidfd, pid_t pid, int sig); // pidfd_send_signal, kill if pidfd is -1
+
 class JobsList
 {
 
@@ -126,12 +332,17 @@ public:
     pid_t job_id;
     pid_t proccess_id;
     time_t init_time; 
+    double start_time; // CLOCK_MONOTONIC, for the exact wall time of the job
     bool is_stopped; 
     bool is_finished;
+    int pidfd; // -1 for built-ins (or if pidfd_open failed): then the pid is used
+    std::shared_ptr<BuiltInTask> task; // set for built-ins running on the thread pool
 
   public:
-    JobEntry() = default; 
-    ~JobEntry() = default;
+    JobEntry();
+    ~JobEntry(); // closes the pidfd
+    JobEntry(JobEntry const &) = delete;
+    void operator=(JobEntry const &) = delete;
     void setJobID(pid_t job_id); 
     pid_t getJobID() const; 
     void setCmd(std::string cmd);
@@ -140,74 +351,171 @@ public:
     pid_t getProccessId() const;
     void setInitTime(time_t init_time);
     time_t getInitTime() const; 
+    void setStartTime(double start_time);
+    double getStartTime() const;
     bool getIsStopped() const;
     void setIsStopped(bool isStopped);
     bool getIsFinished() const; 
     void setIsFinished(bool isFinished);
+    std::shared_ptr<BuiltInTask> getTask() const;
+    void setTask(std::shared_ptr<BuiltInTask> task);
+    bool isBuiltIn() const;
+    void setPidFd(int pidfd);
+    int getPidFd() const;
+    int signal(int sig) const; // through the pidfd, so a recycled pid is never hit
+  };
+  // a finished job (or foreground command, job_id 0) with what it used, as reported by wait4
+  struct FinishedJob
+  {
+    int job_id;
+    std::string cmd;
+    pid_t pid;
+    int status; // wait status, -1 for built-ins
+    double wall_time;
+    struct rusage usage;
+    PerfCounters::Totals perf;
   };
+  static const size_t HISTORY_SIZE = 64;
   std::vector<JobEntry*> jobs_list;
+  std::map<pid_t, int> watched; // pid -> exit status (-1 while still running)
+  std::deque<FinishedJob> history; // the last HISTORY_SIZE finished jobs, oldest first
+  std::vector<JobEntry*> killed_jobs; // out of the list after kill -9 / ctrl-C, until their son is reaped
+  std::map<pid_t, std::shared_ptr<PerfCounters> > perf_counters; // counted sons, until they are reaped
+  struct rusage* sons_usage = nullptr; // while time runs: the sons started since sons_since add up here when reaped
+  double sons_since = 0;
 
   JobsList() = default;
   ~JobsList(); 
   void addJob(Command *cmd, bool isStopped = false);
-  void printJobsList();
-  void killAllJobs(); //print all jobs
+  void addBuiltInJob(Command *cmd, ThreadPool* pool); // takes ownership of cmd
+  void printJobsList(std::ostream& out = std::cout);
+  void printJobsVerbose(std::ostream& out); // jobs -v: exact times and the finished jobs' usage
+  void killAllJobs(); // quit kill: SIGTERM, SIGKILL after a deadline, reaps and reports each job
   void removeFinishedJobs();
+  void recordFinished(int job_id, const std::string& cmd, pid_t pid, double start_time, int status, const struct rusage& usage);
+  void reapedProccess(pid_t p, int status, const struct rusage& usage); // records and removes p's job
+  void attachPerfCounters(pid_t p); // before p execs
+  PerfCounters::Totals getPerfTotals(pid_t p) const; // so far, not counted if p has no counters
   JobEntry *getJobById(int jobId);
   void removeJobById(int jobId);
   void removeJobByPid(pid_t p);
+  void removeKilledJob(pid_t p); // p got SIGKILL: off the list now, in the history once it is reaped
   JobEntry *getLastJob(int *lastJobId);
   JobEntry *getLastStoppedJob(int *jobId);
 
-  JobEntry *getJobByPid(int job_pid);
+  JobEntry *getJobByPid(int job_pid); // built-in jobs (pid -1) are never found by pid
   pid_t getMaxJobID();
   bool isJobsListEmpty();   
+  void watchProccess(pid_t p); // keep p's exit status if it is reaped by removeFinishedJobs
+  bool takeWatchedStatus(pid_t p, int* status); // true (and unwatch) if p was already reaped
+  void unwatchProccess(pid_t p);
 };
 
 class TimedList{
 
 public:
+ // a command run by timeout [-k grace] duration. its timer's SIGALRM carries the entry's id
  class TimedEntry{
-    pid_t pid; //pid of son counting time
-    pid_t pid_to_kill; //pid of his "sibling" to be killed
+    int id;
+    timer_t timer;
+    bool has_timer;
+    pid_t pid_to_kill; // leads the process group the command runs in
     std::string cmd_to_kill;
-    time_t start_time;
-    int duration;
-    double running_time;
+    double start_time; // CLOCK_MONOTONIC
+    double duration;   // the budget, seconds
+    double grace;      // from SIGTERM to SIGKILL, seconds
+    double running_time; // the actual elapsed time once the command finished (was reaped), -1 before
+    double end_time;     // CLOCK_MONOTONIC when its son exited, noted on SIGCHLD. -1 before
+    bool timed_out;    // SIGTERM was sent, the next expiry sends SIGKILL
+    int pidfd; // of pid_to_kill, -1 if pidfd_open failed. closed when the command finishes
 
   public:
-    TimedEntry() = default; 
-    TimedEntry(pid_t _pid, pid_t _pid_to_kill, std::string _cmd_to_kill, int duration, double running_time = 0);
-    ~TimedEntry() = default;
-    pid_t getPid() const; 
-    void setPid(pid_t _pid);
+    TimedEntry(int id, pid_t _pid_to_kill, std::string _cmd_to_kill, double duration, double grace, int pidfd);
+    int getId() const;
     pid_t getPidToKill() const; 
-    void setPidToKill(pid_t _pid_to_kill);
     std::string getCmdToKill() const; 
-    void setCmdToKill(std::string _cmd_to_kill);
-    int getDuration() const;
-    time_t getStartTime() const;
+    double getDuration() const;
+    double getGrace() const;
+    double getStartTime() const;
     double getRunningTime() const;
     void setRunningTime(double running_time);
+    double getEndTime() const;
+    void noteEnded(); // async signal safe: the end time, if the pidfd says the son exited
+    bool isTimedOut() const;
+    void setTimedOut();
+    bool hasTimer() const;
+    bool arm(double seconds); // one shot CLOCK_MONOTONIC timer, false (errno set) on failure
+    void disarm();
+    int signalGroup(int sig) const; // the whole process group, while its leader is not reaped
+    void closePidFd();
  };
 
- std::list<TimedEntry> timedList;
+ static const size_t FINISHED_SIZE = 64;
+ std::list<TimedEntry> timedList; // newest first
+ int next_id;
 
- TimedList() = default; 
+ TimedList(); 
  ~TimedList() = default; 
- void addTimedEntry(pid_t _pid, pid_t _pid_to_kill, std::string _cmd, int _duration);
- void removeTimedEntry (pid_t _pid);
- TimedEntry& getTimedEntryByPid(pid_t pid);
- bool isTimedOut(pid_t _pid); // returns true if (current_time - start_time) <= duration_time
+ // pidfd: of _pid_to_kill, the entry keeps a copy. nullptr: no timer
+ TimedEntry* addTimedEntry(pid_t _pid_to_kill, std::string _cmd, double duration, double grace, int pidfd);
+ TimedEntry* getTimedEntryById(int id);
+ void finishTimedEntry(pid_t _pid_to_kill); // the command ended (it was reaped): records its time
+ void noteEnded(); // SIGCHLD: notes the end time of the timed commands that exited, before they are reaped
+ void expire(int id); // SIGALRM of entry id: SIGTERM, or SIGKILL once the grace is over
+ void printTimedEntries(std::ostream& out);
 };
 
 
+// jobs [-v] [--top [interval] [count]]
 class JobsCommand : public BuiltInCommand
 {
+  // the /proc files of a job's group members stay open between refreshes, every refresh is two
+  // preads per member
+  struct TopMember
+  {
+    int stat_fd;
+    int io_fd;
+    bool sampled;                 // the counters below hold a previous sample
+    unsigned long long cpu_ticks; // utime + stime
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+  };
+  struct TopSample
+  {
+    std::map<pid_t, TopMember> members;
+    int refreshes; // left until the members are looked up in /proc again
+    double time;
+  };
+  struct TopRow
+  {
+    int job_id;
+    pid_t pid;
+    char state;  // from /proc, '-' for built-in threads
+    double cpu;  // percent of one cpu since the previous refresh
+    unsigned long long rss; // bytes
+    double read_rate;  // bytes per second
+    double write_rate;
+    std::string cmd;
+  };
   JobsList* c_jobs; 
+  static void closeSample(TopSample& sample);
+  void sampleJobs(std::map<pid_t, TopSample>& samples, std::vector<TopRow>& rows);
+  void top(double interval, long count);
 public:
   JobsCommand(const char *cmd_line, JobsList *jobs);
   virtual ~JobsCommand() {}
+  bool canRunInPipe() const override;
+  void execute() override;
+};
+
+// wait [-n] [job-id ...]: blocks until all (-n: any) of the given jobs, or of all the jobs, have
+// finished, on one epoll of their pidfds (and the eventfds of built-ins). ctrl-C stops waiting
+class WaitCommand : public BuiltInCommand
+{
+  JobsList* c_jobs;
+public:
+  WaitCommand(const char *cmd_line, JobsList* jobs);
+  virtual ~WaitCommand() {}
   void execute() override;
 };
 
@@ -240,9 +548,12 @@ public:
 
 class TailCommand : public BuiltInCommand
 {
+  void tailFile(const char* file_path, int num_lines);
 public:
   TailCommand(const char *cmd_line);
   virtual ~TailCommand() = default;
+  bool canRunInBackground() const override;
+  bool canRunInPipe() const override;
   void execute() override;
 };
 
@@ -251,9 +562,341 @@ class TouchCommand : public BuiltInCommand
 public:
   TouchCommand(const char *cmd_line);
   virtual ~TouchCommand() {}
+  bool canRunInBackground() const override;
+  bool canRunInPipe() const override;
+  void execute() override;
+};
+
+// concatenates files (or the input fd) to the output fd, moving the data inside the kernel
+// (copy_file_range / sendfile / splice) whenever the fd types allow it
+class CatCommand : public BuiltInCommand
+{
+public:
+  CatCommand(const char *cmd_line);
+  virtual ~CatCommand() {}
+  bool canRunInBackground() const override;
+  bool canRunInPipe() const override;
   void execute() override;
 };
 
+// copies its input to the output fd and to every given file. pipe input is duplicated with
+// tee(2) and moved with splice(2), so the data never passes through user space
+class TeeCommand : public BuiltInCommand
+{
+  struct TeeTarget
+  {
+    int fd;
+    bool use_splice; // cleared once splice was refused for this fd
+    bool failed;
+  };
+  void teeFromPipe(std::vector<TeeTarget>& targets);
+  void teeBuffered(std::vector<TeeTarget>& targets);
+  bool writeTarget(TeeTarget& target, const char* buf, size_t len);
+public:
+  TeeCommand(const char *cmd_line);
+  virtual ~TeeCommand() {}
+  bool canRunInBackground() const override;
+  bool canRunInPipe() const override;
+  void execute() override;
+};
+
+// counts lines / words / bytes. regular files are split into shards, each read with pread and
+// counted on the thread pool with vectorized (SSE2/AVX2) kernels, anything else is read sequentially
+class WcCommand : public BuiltInCommand
+{
+  struct WcCounts
+  {
+    unsigned long long lines;
+    unsigned long long words;
+    unsigned long long bytes;
+  };
+  bool count_lines;
+  bool count_words;
+  bool count_bytes;
+  bool countFile(int fd, WcCounts& counts);
+  bool countStream(int fd, WcCounts& counts);
+  std::string formatCounts(const WcCounts& counts, int width, const std::string& name) const;
+public:
+  WcCommand(const char *cmd_line);
+  virtual ~WcCommand() {}
+  bool canRunInBackground() const override;
+  bool canRunInPipe() const override;
+  void execute() override;
+};
+
+// prints the lines matching an extended regex (or a fixed string with -F). candidate lines are
+// found with a literal the pattern requires, and only those are confirmed by the regex. files
+// are mapped and searched in shards on the thread pool, the output keeps the file order
+class SearchCommand : public BuiltInCommand
+{
+  struct SearchMatch
+  {
+    unsigned long long line; // newlines before the line, counted from the start of the shard
+    size_t start;
+    size_t end; // without the '\n'
+  };
+  std::string pattern;
+  std::string literal; // every matching line contains it (empty: no prefilter)
+  bool ignore_case;
+  bool line_numbers;
+  bool fixed; // the pattern is the literal itself, no regex confirm needed
+  void searchRange(const char* data, size_t len, const regex_t* regex, std::vector<SearchMatch>& matches, unsigned long long& newlines) const;
+  bool searchStream(int fd, const std::string& prefix, const regex_t* regex);
+  void appendMatches(std::string& out, const char* data, const std::vector<SearchMatch>& matches,
+                     unsigned long long first_line, const std::string& prefix) const;
+public:
+  SearchCommand(const char *cmd_line);
+  virtual ~SearchCommand() {}
+  bool canRunInBackground() const override;
+  bool canRunInPipe() const override;
+  void execute() override;
+};
+
+// find-like tree walk: every worker owns a deque of directories, takes the newest one of its
+// own and steals the oldest one of another worker when it runs dry. entries are listed with
+// getdents64 and only stat'ed (fstatat) when the predicates need more than the entry type
+class WalkCommand : public BuiltInCommand
+{
+  struct WalkWorker
+  {
+    std::mutex lock;
+    std::deque<std::string> dirs;
+    std::string out;                  // printed paths not written yet
+    std::vector<std::string> touched; // paths for -touch
+  };
+  std::string name_glob;
+  char type;      // 'f', 'd', 'l' or 0 for any
+  int size_cmp;   // -1 less than, 0 exactly, 1 more than, 2 no -size predicate
+  unsigned long long size_value;
+  unsigned long long size_unit;
+  int mtime_cmp;  // like size_cmp, the age is counted in whole days
+  long mtime_days;
+  bool print0;
+  bool touch;
+  struct timespec touch_time;
+  time_t now;
+  std::vector<std::unique_ptr<WalkWorker> > workers;
+  std::atomic<long> pending; // directories queued or being listed, 0 ends the walk
+  std::mutex out_lock;
+  std::atomic<bool> failed;  // the output is gone (e.g. the reader of the pipe exited)
+  bool parseArgs(std::vector<std::string>& roots);
+  bool needsStat() const;
+  bool matches(const char* name, char entry_type, const struct stat* st) const;
+  void found(WalkWorker& worker, const std::string& path);
+  void flush(WalkWorker& worker);
+  bool nextDir(size_t self, std::string& dir);
+  void walkDir(WalkWorker& worker, const std::string& path);
+public:
+  WalkCommand(const char *cmd_line);
+  virtual ~WalkCommand() {}
+  bool canRunInBackground() const override;
+  bool canRunInPipe() const override;
+  void execute() override;
+};
+
+// runs the commands of a dependency file, ready nodes in parallel (up to -j workers)
+// every node line looks like "name: dep1 dep2 -> command"
+class DagCommand : public BuiltInCommand
+{
+  JobsList* c_jobs;
+  struct DagNode
+  {
+    std::string name;
+    std::string cmd;
+    std::vector<std::string> deps;
+    std::vector<int> dependents;
+    int unmet_deps;
+    pid_t pid;
+    int state;      // one of the DAG_* states
+    int exit_status;
+    double start_time; // seconds since the dag started (CLOCK_MONOTONIC)
+    double end_time;
+  };
+  bool parseDagFile(const char* path, std::vector<DagNode>& nodes);
+  void finishNode(std::vector<DagNode>& nodes, int i, int status, std::list<int>& ready);
+  void printReport(const std::vector<DagNode>& nodes, double total_time);
+public:
+  DagCommand(const char *cmd_line, JobsList *jobs);
+  virtual ~DagCommand() {}
+  void execute() override;
+};
+
+// log bucketed latency histogram, HDR style: 8 linear sub-buckets per power of two, so every
+// value is kept to within 12.5%. recording is a few instructions and never allocates
+class LatencyHistogram
+{
+  static const int SUB_BUCKETS = 8;
+  static const int BUCKETS = 62 * SUB_BUCKETS;
+  unsigned long long counts[BUCKETS];
+  unsigned long long count;
+  unsigned long long sum;
+  unsigned long long min;
+  unsigned long long max;
+  static int bucketOf(unsigned long long ns);
+  static unsigned long long bucketTop(int bucket); // the highest value that falls in the bucket
+public:
+  LatencyHistogram();
+  void record(unsigned long long ns);
+  void reset();
+  unsigned long long getCount() const;
+  unsigned long long getMin() const;
+  unsigned long long getMax() const;
+  double getMean() const;
+  unsigned long long percentile(double p) const;
+  void dump(std::ostream& out) const; // json, the non empty buckets as [highest value, count]
+};
+
+// what the smash spends on a command, by the kind of the typed command line
+enum StatKind { STAT_BUILT_IN, STAT_EXTERNAL, STAT_PIPE, STAT_REDIRECT, STAT_KINDS };
+// parse: CreateCommand, fork: fork() in the parent, run: from fork until the wait returns,
+// reap: after the wait (or the start of a background job) until the smash is ready again
+enum StatPhase { STAT_PARSE, STAT_FORK, STAT_RUN, STAT_REAP, STAT_TOTAL, STAT_PHASES };
+
+// stats [--reset] [--dump file]: percentiles of the histograms of every kind and phase
+class StatsCommand : public BuiltInCommand
+{
+public:
+  StatsCommand(const char *cmd_line);
+  virtual ~StatsCommand() = default;
+  bool canRunInPipe() const override;
+  void execute() override;
+};
+
+// timestamped events of the smash and its sons (trace on / off), written as chrome trace JSON.
+// the ring buffer is a MAP_SHARED mapping, so sons record their exec / dup2 between fork and
+// exec into the smash's buffer. recording is lock free (a fetch_add picks the slot), so it is
+// safe from signal handlers and threads too. when the ring is full the oldest events are lost
+class Tracer
+{
+  static const unsigned long long CAPACITY = 1 << 16;
+  struct EventData
+  {
+    unsigned long long ts;   // CLOCK_MONOTONIC ns
+    unsigned long long dur;  // ns, for complete ('X') events
+    int pid;
+    int tid;
+    char ph;                 // 'i' instant, 'X' complete
+    const char* name;        // string literals only, they are at the same address in the sons
+    const char* arg_name;    // nullptr: no arg
+    long long arg;
+    char text[80];
+  };
+  // a seqlock: seq is 0 while data is written, readers copy data and check seq again
+  struct Event
+  {
+    std::atomic<unsigned long long> seq; // the event's number + 1 once it is fully written
+    EventData data;
+  };
+  struct Ring
+  {
+    std::atomic<unsigned long long> head;
+    Event events[CAPACITY];
+  };
+  Ring* ring;
+  std::atomic<bool> enabled; // read by the pool threads and the signal handlers
+  std::string path;
+  unsigned long long start_ns;
+  void record(char ph, const char* name, unsigned long long ts, unsigned long long dur, pid_t pid,
+              const char* arg_name, long long arg, const char* text);
+public:
+  Tracer();
+  ~Tracer();
+  Tracer(Tracer const &) = delete;
+  void operator=(Tracer const &) = delete;
+  static unsigned long long now();
+  bool start(const std::string& file_path);
+  bool stop(); // writes the file
+  bool isOn() const;
+  // pid 0: the calling process
+  void instant(const char* name, const char* arg_name = nullptr, long long arg = 0, const char* text = nullptr, pid_t pid = 0);
+  void complete(const char* name, unsigned long long begin_ns, unsigned long long end_ns, const char* text = nullptr, pid_t pid = 0);
+};
+
+// trace on file.json / trace off
+class TraceCommand : public BuiltInCommand
+{
+public:
+  TraceCommand(const char *cmd_line);
+  virtual ~TraceCommand() = default;
+  void execute() override;
+};
+
+// while a foreground command runs, a thread of the smash slows the background jobs' process groups
+// down (throttle on): SIGSTOP / SIGCONT duty cycles that let them run percent of every 100ms, or
+// nice 19. it starts after a short grace period, so quick commands never pay for it, does not touch
+// the jobs' is_stopped, and has everything back at full speed before end() returns
+class Throttler
+{
+public:
+  enum Mode { OFF, STOP, NICE };
+  struct Group
+  {
+    pid_t pgid; // the job's son leads it
+    int pidfd;  // of the son, -1 if it has none. the group is only signaled while the son is not reaped
+  };
+private:
+  static const int GRACE_MS = 5;
+  static const int PERIOD_MS = 100;
+  std::mutex lock;
+  std::condition_variable cond;
+  std::thread* worker; // started on first use, only by (and for) the smash that owns it
+  pid_t owner;
+  Mode mode;
+  int percent;
+  bool active;   // a foreground command is running
+  bool restored; // the worker has nothing stopped or reniced
+  bool quit;
+  std::vector<Group> groups; // with pidfds of their own, closed by end()
+  void run();
+public:
+  Throttler();
+  ~Throttler();
+  Throttler(Throttler const &) = delete;
+  void operator=(Throttler const &) = delete;
+  void setMode(Mode mode, int percent = 0);
+  Mode getMode();
+  int getPercent();
+  bool begin(const std::vector<Group>& groups); // false: nothing to throttle (or off, or already on)
+  void end();
+};
+
+// throttle [on [stop [percent] | nice] | off]
+class ThrottleCommand : public BuiltInCommand
+{
+public:
+  ThrottleCommand(const char *cmd_line);
+  virtual ~ThrottleCommand() = default;
+  void execute() override;
+};
+
+// directory listings (read with getdents64) for glob expansion, reused until the directory's
+// mtime changes so that globbing the same big directory in a loop reads it only once
+class DirCache
+{
+public:
+  struct DirEntry
+  {
+    std::string name;
+    unsigned char type; // DT_* from getdents64, DT_UNKNOWN if the file system does not tell
+  };
+private:
+  struct Listing
+  {
+    struct timespec mtime;
+    ino_t ino;
+    std::shared_ptr<const std::vector<DirEntry> > entries; // sorted by name
+  };
+  std::map<std::string, Listing> listings;
+  std::mutex lock;
+public:
+  // the sorted entries of dir, nullptr (errno set) on error. shared, so a hit costs no copy
+  std::shared_ptr<const std::vector<DirEntry> > getEntries(const std::string& dir);
+  void clear();
+};
+
+bool _readDirEntries(int dir_fd, std::vector<DirCache::DirEntry>& entries);
+std::vector<std::string> _expandGlob(const std::string& pattern);
+
 class SmallShell
 {
 private:
@@ -266,6 +909,21 @@ private:
   bool s_is_piped;
   bool s_is_fg;
   TimedList s_timedlist;  
+  ThreadPool* s_pool;
+  DirCache s_dir_cache;
+  Command* s_fg_built_in; // the built-in the smash is currently waiting on (ctrl-C cancels it)
+  std::map<int, int> s_fd_slots; // exec slot number -> the (close-on-exec) fd opened for it
+  bool s_exec_timing;     // external commands measure their fork to exec time (time built-in)
+  double s_exec_latency;  // sum of the measured fork to exec times
+  int s_exec_count;
+  volatile sig_atomic_t s_interrupts; // ctrl-C presses, so loops of commands can stop
+  LatencyHistogram s_stats[STAT_KINDS][STAT_PHASES]; // always on, filled by the main thread
+  int s_stat_kind;    // kind of the command line being executed
+  double s_wait_end;  // when its son was waited for (0: not yet)
+  Tracer s_tracer;
+  bool s_perf;        // external commands get perf counters (SMASH_PERF=1, perfstat on)
+  SchedSettings s_launch_sched; // applied by the sons of external commands before exec
+  Throttler s_throttler;
 
   SmallShell();
 
@@ -280,7 +938,8 @@ public:
     return instance;
   }
   ~SmallShell();
-  void executeCommand(const char *cmd_line);
+  void executeCommand(const char *cmd_line, int out_fd = STDOUT_FILENO); // out_fd: where the command's data goes
+  void runCommand(Command *cmd, bool is_bg); // runs (or starts in the background) and deletes cmd
 
   void setPrompt(std::string new_prompt);
   std::string getPrompt();
@@ -290,6 +949,29 @@ public:
   pid_t getCurrentPid();
   JobsList* getJobsList();
   TimedList& getTimedList();
+  ThreadPool* getThreadPool(); // created on first use
+  void forgetThreadPool(); // in a forked son, the next use creates a pool of its own
+  DirCache& getDirCache();
+  Command* getForegroundBuiltIn() const;
+  void setForegroundBuiltIn(Command* command);
+  int getFdSlot(int slot) const; // -1 if the slot is not open
+  void setFdSlot(int slot, int fd); // closes the fd the slot had before
+  bool closeFdSlot(int slot);
+  bool isExecTiming() const;
+  void setExecTiming(bool exec_timing);
+  void addExecLatency(double latency);
+  double getExecLatency(int* count) const; // the sum so far and the number of execs
+  void addInterrupt(); // called by the ctrl-C handler
+  void recordStat(int phase, double seconds); // for the command line being executed
+  void setWaitEnd(double wait_end);
+  LatencyHistogram& getStat(int kind, int phase);
+  Tracer& getTracer();
+  bool isPerfOn() const;
+  void setPerf(bool perf);
+  Throttler& getThrottler();
+  const SchedSettings& getLaunchSched() const;
+  void setLaunchSched(const SchedSettings& sched);
+  int getInterrupts() const;
 
   void setQuit(bool quit_);
   bool getQuit() const;
@@ -0,0 +1,41 @@
+#!/bin/bash
+# throughput of the smash cat built-in against /bin/cat (run by bash, and by the smash as an
+# external command) for file -> file and file -> pipe copies.
+# usage: bench/cat_bench.sh [size-in-MB] [runs]   (run from the repository root, after "make smash")
+SMASH=${SMASH:-./smash}
+SIZE_MB=${1:-256}
+RUNS=${2:-3}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+head -c $((SIZE_MB * 1024 * 1024)) /dev/urandom > "$DIR/in"
+
+# best of RUNS wall time (ns) of: bash -c "$1" when $2 is "bash", or the smash reading $1
+best_ns() {
+  local best=0
+  for ((i = 0; i < RUNS; i++)); do
+    rm -f "$DIR/out" # truncating the previous output would be timed too
+    local start=$(date +%s%N)
+    if [ "$2" = bash ]; then
+      bash -c "$1"
+    else
+      printf '%s\nquit\n' "$1" | "$SMASH" > /dev/null
+    fi
+    local took=$(($(date +%s%N) - start))
+    if [ $best -eq 0 ] || [ $took -lt $best ]; then best=$took; fi
+  done
+  echo $best
+}
+
+report() {
+  local ns=$(best_ns "$2" "$3")
+  awk -v name="$1" -v mb=$SIZE_MB -v ns=$ns 'BEGIN { printf "%-42s %8.1f MB/s  (%d ms)\n", name, mb * 1e9 / ns, ns / 1e6 }'
+}
+
+echo "cat throughput, ${SIZE_MB} MB, best of ${RUNS}"
+report "file -> file   bash  /bin/cat"      "/bin/cat $DIR/in > $DIR/out" bash
+report "file -> file   smash /bin/cat"      "/bin/cat $DIR/in > $DIR/out" smash
+report "file -> file   smash cat built-in"  "cat $DIR/in > $DIR/out" smash
+report "file -> pipe   bash  /bin/cat"      "/bin/cat $DIR/in | /bin/cat > /dev/null" bash
+report "file -> pipe   smash /bin/cat"      "/bin/cat $DIR/in | /bin/cat > /dev/null" smash
+report "file -> pipe   smash cat built-in"  "cat $DIR/in | /bin/cat > /dev/null" smash
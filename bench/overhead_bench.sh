@@ -0,0 +1,32 @@
+#!/bin/bash
+# the smash's own cost per command, from its bench built-in, next to the same commands run in a
+# bash loop: starting an external program (direct exec, and through bash for a command line the
+# smash cannot expand itself) and a built-in that runs inside the smash.
+# usage: bench/overhead_bench.sh [runs]   (run from the repository root, after "make smash")
+SMASH=${SMASH:-./smash}
+RUNS=${1:-500}
+
+# mean latency (us) of a bash loop running $1 RUNS times
+bash_us() {
+  local start=$(date +%s%N)
+  bash -c "for ((i = 0; i < $RUNS; i++)); do $1; done" > /dev/null
+  echo $((($(date +%s%N) - start) / RUNS / 1000))
+}
+
+# the bench built-in's report for $1, as "p50 p99" in us
+smash_us() {
+  printf 'bench -q -n %s -w 10 %s\nquit\n' "$RUNS" "$1" | "$SMASH" |
+    awk '/^min / { printf "%.0f %.0f\n", $4 * 1e6, $8 * 1e6 }'
+}
+
+report() {
+  local bash_mean=$(bash_us "$2")
+  read -r p50 p99 <<< "$(smash_us "$3")"
+  printf '%-34s bash loop %6s us   smash p50 %6s us  p99 %6s us\n' "$1" "$bash_mean" "$p50" "$p99"
+}
+
+echo "per command latency, $RUNS runs, $(nproc) cpus"
+report "external (direct exec)"        "/bin/true"             "/bin/true"
+report "external (through bash)"       "/bin/true \$HOME"      "/bin/true \$HOME"
+report "external with a redirection"   "/bin/echo x > /dev/null" "/bin/echo x > /dev/null"
+report "built-in"                      "pwd"                   "pwd"
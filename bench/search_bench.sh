@@ -0,0 +1,56 @@
+#!/bin/bash
+# throughput of the smash search built-in against grep -E (run by bash, and by the smash as an
+# external command, alone and behind cat) for a literal, regexes with a required literal in them
+# and a case insensitive literal.
+# usage: bench/search_bench.sh [size-in-MB] [runs]   (run from the repository root, after "make smash")
+SMASH=${SMASH:-./smash}
+SIZE_MB=${1:-256}
+RUNS=${2:-3}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# base64 lines, repeated up to the wanted size
+base64 -w 76 < /dev/urandom | head -c 8000000 > "$DIR/chunk"
+while [ $(stat -c %s "$DIR/chunk") -lt $((SIZE_MB * 1024 * 1024)) ]; do
+  cat "$DIR/chunk" "$DIR/chunk" > "$DIR/chunk2" && mv "$DIR/chunk2" "$DIR/chunk"
+done
+head -c $((SIZE_MB * 1024 * 1024)) "$DIR/chunk" > "$DIR/in"
+rm -f "$DIR/chunk"
+
+# best of RUNS wall time (ns) of: bash -c "$1" when $2 is "bash", or the smash reading $1.
+# the output goes to a file - grep stops at the first match when it writes to /dev/null
+best_ns() {
+  local best=0
+  for ((i = 0; i < RUNS; i++)); do
+    local start=$(date +%s%N)
+    if [ "$2" = bash ]; then
+      bash -c "$1" > "$DIR/out"
+    else
+      printf '%s\nquit\n' "$1" | "$SMASH" > "$DIR/out"
+    fi
+    local took=$(($(date +%s%N) - start))
+    if [ $best -eq 0 ] || [ $took -lt $best ]; then best=$took; fi
+  done
+  echo $best
+}
+
+report() {
+  local ns=$(best_ns "$2" "$3")
+  awk -v name="$1" -v mb=$SIZE_MB -v ns=$ns 'BEGIN { printf "%-46s %8.1f MB/s  (%d ms)\n", name, mb * 1e9 / ns, ns / 1e6 }'
+}
+
+echo "search throughput, ${SIZE_MB} MB, $(nproc) cpus, best of ${RUNS}"
+for pattern in "ABCD" "AB+C.x" "[0-9]{3}zz" "-i abcd"; do
+  # the matches have to agree before the speed matters
+  expected=$(grep -E $pattern "$DIR/in" | md5sum)
+  got=$(printf 'search %s %s\nquit\n' "$pattern" "$DIR/in" | "$SMASH" | sed -e 's/^smash> //' -e '/^smash> *$/d' | md5sum)
+  if [ "$expected" != "$got" ]; then
+    echo "search built-in output differs from grep -E for '$pattern'"
+    exit 1
+  fi
+  report "'$pattern'  bash  grep -E"             "grep -E $pattern $DIR/in" bash
+  report "'$pattern'  smash grep -E"             "grep -E $pattern $DIR/in" smash
+  report "'$pattern'  smash search built-in"     "search $pattern $DIR/in" smash
+  report "'$pattern'  smash cat | grep -E"       "cat $DIR/in | grep -E $pattern" smash
+  report "'$pattern'  smash cat | search built-in" "cat $DIR/in | search $pattern" smash
+done
@@ -0,0 +1,334 @@
+// micro and macro benchmarks of the smash, linked with the same Commands.o / signals.o as the
+// smash itself: command parsing, external command launch, pipes, tail, the jobs list and timeout.
+// prints the results as JSON, --compare checks them against a saved run.
+// usage: bench/smash_bench [--quick] [--full] [--out file.json] [--compare baseline.json] [--threshold percent]
+//   --quick: smaller pipe input, --full: also tail a 1GB file (tail reads a byte per read(), minutes)
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <functional>
+#include <string>
+#include <vector>
+#include <map>
+#include "../Commands.h"
+#include "../signals.h"
+
+struct Result
+{
+  std::string name;
+  long ops;
+  double ns_per_op;
+  double mb_per_s; // 0 when the benchmark does not move data
+};
+
+// a job entry needs a command, this one never runs
+class NopCommand : public Command
+{
+public:
+  NopCommand(const char* cmd_line, pid_t pid) : Command(cmd_line) { setPid(pid); }
+  void execute() override {}
+};
+
+static std::vector<Result> results;
+static int saved_stdout = -1;
+
+static double _nowNs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// the commands' output goes to /dev/null while measuring, the report to the real stdout
+static void _quiet(bool on)
+{
+  std::cout.flush();
+  if (on)
+  {
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    saved_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+  }
+  else
+  {
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    saved_stdout = -1;
+  }
+}
+
+static void _measure(const std::string& name, long ops, std::function<void()> op, double bytes_per_op = 0)
+{
+  _quiet(true);
+  double start = _nowNs();
+  for (long i = 0; i < ops; i++)
+  {
+    op();
+  }
+  double ns = (_nowNs() - start) / ops;
+  _quiet(false);
+  Result result = {name, ops, ns, bytes_per_op > 0 ? bytes_per_op / ns * 1e9 / (1 << 20) : 0};
+  results.push_back(result);
+  std::cerr << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(1)
+            << std::setw(14) << ns << " ns/op";
+  if (result.mb_per_s > 0)
+    std::cerr << std::setw(10) << result.mb_per_s << " MB/s";
+  std::cerr << std::endl;
+}
+
+// a file of numbered lines, about size bytes
+static void _makeFile(const std::string& path, size_t size)
+{
+  std::ofstream out(path.c_str(), std::ios::binary);
+  std::string block;
+  for (int i = 0; block.size() < (1 << 20); i++)
+  {
+    block += "line " + std::to_string(i) + " of the benchmark input file\n";
+  }
+  for (size_t written = 0; written < size; written += block.size())
+  {
+    out.write(block.data(), block.size());
+  }
+}
+
+static off_t _fileSize(const std::string& path)
+{
+  struct stat st;
+  return (stat(path.c_str(), &st) == 0) ? st.st_size : 0;
+}
+
+static void _benchParse()
+{
+  SmallShell& smash = SmallShell::getInstance();
+  const char* lines[] = {"ls -l /tmp", "pwd", "cat a | wc -l", "echo x > f", "sleep 1&", "tail -10 f", "search -i err log"};
+  for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++)
+  {
+    std::string line = lines[i];
+    _measure("parse/" + line, 100000, [&smash, line]() { delete smash.CreateCommand(line.c_str()); });
+  }
+}
+
+static void _benchLaunch()
+{
+  SmallShell& smash = SmallShell::getInstance();
+  _measure("launch/direct exec", 300, [&smash]() { smash.executeCommand("/bin/true"); });
+  _measure("launch/through bash", 300, [&smash]() { smash.executeCommand("/bin/true $HOME"); });
+  _measure("launch/redirected", 300, [&smash]() { smash.executeCommand("/bin/true > /dev/null"); });
+}
+
+static void _benchPipes(const std::string& dir, bool quick)
+{
+  SmallShell& smash = SmallShell::getInstance();
+  std::string data = dir + "/pipe_input";
+  _makeFile(data, (quick ? 16 : 128) << 20);
+  double bytes = _fileSize(data);
+  std::string two = "/bin/cat " + data + " | /bin/cat";
+  std::string built_in = "cat " + data + " | wc -c";
+  std::string four = "/bin/cat " + data + " | /bin/cat | /bin/cat | /bin/cat";
+  _measure("pipe/2 stages external", 3, [&smash, two]() { smash.executeCommand(two.c_str()); }, bytes);
+  _measure("pipe/2 stages built-in", 3, [&smash, built_in]() { smash.executeCommand(built_in.c_str()); }, bytes);
+  _measure("pipe/4 stages external", 3, [&smash, four]() { smash.executeCommand(four.c_str()); }, bytes);
+  unlink(data.c_str());
+}
+
+static void _benchTail(const std::string& dir, bool full)
+{
+  SmallShell& smash = SmallShell::getInstance();
+  size_t sizes[] = {1 << 20, (size_t)1 << 30};
+  const char* names[] = {"1MB", "1GB"};
+  long ops[] = {5, 1};
+  for (int i = 0; i < (full ? 2 : 1); i++)
+  {
+    std::string path = dir + "/tail_input";
+    _makeFile(path, sizes[i]);
+    std::string last_10 = "tail -10 " + path;
+    std::string last_10k = "tail -10000 " + path;
+    _measure(std::string("tail/-10 ") + names[i], ops[i], [&smash, last_10]() { smash.executeCommand(last_10.c_str()); });
+    _measure(std::string("tail/-10000 ") + names[i], ops[i], [&smash, last_10k]() { smash.executeCommand(last_10k.c_str()); });
+    unlink(path.c_str());
+  }
+}
+
+// a jobs list of n jobs (pids that do not exist, nothing is ever signaled), then the operations
+// the built-ins do on it
+static void _benchJobs()
+{
+  JobsList* jobs = SmallShell::getInstance().getJobsList();
+  long sizes[] = {10, 1000, 100000};
+  for (int s = 0; s < 3; s++)
+  {
+    long n = sizes[s];
+    for (long i = 0; i < n; i++)
+    {
+      JobsList::JobEntry* entry = new JobsList::JobEntry();
+      entry->setJobID(i + 1);
+      entry->setProccessId(4000000 + i);
+      entry->setCmd("sleep 100&");
+      entry->setInitTime(time(nullptr));
+      entry->setStartTime(1);
+      entry->setIsStopped(false);
+      entry->setIsFinished(false);
+      jobs->jobs_list.push_back(entry);
+    }
+    std::string size = "@" + std::to_string(n);
+    long ops = std::max(10L, 1000000 / n);
+    NopCommand cmd("sleep 1&", 4999999);
+    _measure("jobs/add+remove" + size, ops, [jobs, &cmd]() {
+      jobs->addJob(&cmd);
+      jobs->removeJobById(jobs->getMaxJobID());
+    });
+    long next = 0;
+    _measure("jobs/lookup" + size, ops * 10, [jobs, n, &next]() {
+      jobs->getJobById((next++ * 7919) % n + 1);
+    });
+    _measure("jobs/print" + size, std::max(3L, ops / 100), [jobs]() {
+      std::ostringstream out;
+      jobs->printJobsList(out);
+    });
+    for (size_t i = 0; i < jobs->jobs_list.size(); i++)
+    {
+      delete jobs->jobs_list[i];
+    }
+    jobs->jobs_list.clear();
+  }
+}
+
+// a timeout starts the command and arms its timer, which is deleted when the command is done
+static void _benchTimeout()
+{
+  SmallShell& smash = SmallShell::getInstance();
+  _measure("timeout/launch", 100, [&smash]() { smash.executeCommand("timeout 1 /bin/true"); });
+}
+
+static void _writeJson(std::ostream& out)
+{
+  out << "{" << std::endl << "  \"benchmarks\": [" << std::endl;
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    out << "    {\"name\": \"" << results[i].name << "\", \"ops\": " << results[i].ops << ", \"ns_per_op\": "
+        << std::fixed << std::setprecision(1) << results[i].ns_per_op << ", \"mb_per_s\": " << results[i].mb_per_s << "}"
+        << (i + 1 < results.size() ? "," : "") << std::endl;
+  }
+  out << "  ]" << std::endl << "}" << std::endl;
+}
+
+// reads the name -> ns_per_op pairs of a file written by _writeJson (one benchmark per line)
+static bool _readBaseline(const char* path, std::map<std::string, double>& baseline)
+{
+  std::ifstream in(path);
+  if (!in)
+    return false;
+  for (std::string line; std::getline(in, line);)
+  {
+    size_t name = line.find("\"name\": \"");
+    size_t ns = line.find("\"ns_per_op\": ");
+    if (name == std::string::npos || ns == std::string::npos)
+      continue;
+    name += 9;
+    baseline[line.substr(name, line.find('"', name) - name)] = atof(line.c_str() + ns + 13);
+  }
+  return true;
+}
+
+// prints the change of every benchmark, true if none got slower by more than threshold percent
+static bool _compare(const std::map<std::string, double>& baseline, double threshold)
+{
+  bool ok = true;
+  std::cout << std::left << std::setw(32) << "benchmark" << std::right << std::setw(14) << "baseline ns"
+            << std::setw(14) << "now ns" << std::setw(10) << "change" << std::endl;
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    std::map<std::string, double>::const_iterator it = baseline.find(results[i].name);
+    if (it == baseline.end() || it->second <= 0)
+      continue;
+    double change = (results[i].ns_per_op / it->second - 1) * 100;
+    bool regressed = change > threshold;
+    ok = ok && !regressed;
+    std::cout << std::left << std::setw(32) << results[i].name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(14) << it->second << std::setw(14) << results[i].ns_per_op
+              << std::setw(9) << std::showpos << change << std::noshowpos << "%" << (regressed ? "  REGRESSED" : "") << std::endl;
+  }
+  return ok;
+}
+
+int main(int argc, char* argv[])
+{
+  bool quick = false;
+  bool full = false;
+  const char* out_path = nullptr;
+  const char* baseline_path = nullptr;
+  double threshold = 20;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--quick") == 0)
+      quick = true;
+    else if (strcmp(argv[i], "--full") == 0)
+      full = true;
+    else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+      out_path = argv[++i];
+    else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc)
+      baseline_path = argv[++i];
+    else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+      threshold = atof(argv[++i]);
+    else
+    {
+      std::cerr << "usage: " << argv[0] << " [--quick] [--full] [--out file.json] [--compare baseline.json] [--threshold percent]" << std::endl;
+      return 2;
+    }
+  }
+  std::map<std::string, double> baseline;
+  if (baseline_path != nullptr && !_readBaseline(baseline_path, baseline))
+  {
+    perror("smash_bench: cannot read the baseline");
+    return 2;
+  }
+
+  // the same alarm and child handling as the smash, timeout depends on it
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = alarmHandler;
+  sigaddset(&sa.sa_mask, SIGCHLD);
+  sa.sa_flags = SA_RESTART | SA_SIGINFO;
+  sigaction(SIGALRM, &sa, nullptr);
+  struct sigaction child_sa;
+  memset(&child_sa, 0, sizeof(child_sa));
+  child_sa.sa_handler = childHandler;
+  sigaddset(&child_sa.sa_mask, SIGALRM);
+  child_sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+  sigaction(SIGCHLD, &child_sa, nullptr);
+
+  char dir_template[] = "/tmp/smash_bench.XXXXXX";
+  if (mkdtemp(dir_template) == nullptr)
+  {
+    perror("smash_bench: mkdtemp failed");
+    return 2;
+  }
+  std::string dir = dir_template;
+
+  _benchParse();
+  _benchLaunch();
+  _benchPipes(dir, quick);
+  _benchTail(dir, full);
+  _benchJobs();
+  _benchTimeout();
+  rmdir(dir.c_str());
+
+  if (out_path != nullptr)
+  {
+    std::ofstream out(out_path);
+    _writeJson(out);
+  }
+  if (baseline_path != nullptr)
+    return _compare(baseline, threshold) ? 0 : 1;
+  _writeJson(std::cout);
+  return 0;
+}
@@ -0,0 +1,28 @@
+#!/bin/bash
+# foreground latency of the smash with CPU bound background jobs, without throttling and with
+# each throttle mode. the jobs are killed by "quit kill" at the end of every run.
+# usage: bench/throttle_bench.sh [jobs] [runs]   (run from the repository root, after "make smash")
+SMASH=${SMASH:-./smash}
+JOBS=${1:-$(($(nproc) * 2))}
+RUNS=${2:-100}
+
+# the bench built-in's report for /bin/true with JOBS spinning jobs, as "p50 p99" in us
+smash_us() {
+  {
+    for ((i = 0; i < JOBS; i++)); do echo "bash -c \"while :; do :; done\"&"; done
+    [ -n "$1" ] && echo "throttle on $1"
+    echo "bench -q -n $RUNS -w 5 /bin/true"
+    echo "quit kill"
+  } | "$SMASH" | awk '/^min / { printf "%.0f %.0f\n", $4 * 1e6, $8 * 1e6 }'
+}
+
+report() {
+  read -r p50 p99 <<< "$(smash_us "$2")"
+  printf '%-22s p50 %7s us  p99 %7s us\n' "$1" "$p50" "$p99"
+}
+
+echo "/bin/true latency with $JOBS spinning background jobs, $RUNS runs, $(nproc) cpus"
+report "no throttling"   ""
+report "throttle stop"   "stop"
+report "throttle stop 0" "stop 0"
+report "throttle nice"   "nice"
@@ -0,0 +1,33 @@
+#!/bin/bash
+# files/sec of the bulk touch built-in (-f list and glob) against one smash touch line per file
+# and against GNU touch driven by xargs.
+# usage: bench/touch_bench.sh [num-of-files]   (run from the repository root, after "make smash")
+SMASH=${SMASH:-./smash}
+FILES=${1:-20000}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+mkdir "$DIR/tree"
+(cd "$DIR/tree" && seq -f 'f%g.o' 1 "$FILES" | xargs touch)
+seq -f "$DIR/tree/f%g.o" 1 "$FILES" > "$DIR/list"
+sed 's/$/ 00:00:12:01:01:2022/; s/^/touch /' "$DIR/list" > "$DIR/per_file"
+
+# $1 = name, the rest = command to time
+report() {
+  local name=$1
+  shift
+  local start=$(date +%s%N)
+  "$@" > /dev/null
+  local ns=$(($(date +%s%N) - start))
+  awk -v name="$name" -v files=$FILES -v ns=$ns 'BEGIN { printf "%-36s %10.0f files/s  (%d ms)\n", name, files * 1e9 / ns, ns / 1e6 }'
+}
+
+smash_lines() {
+  (cat "$@"; echo quit) | "$SMASH"
+}
+
+echo "touch, ${FILES} files"
+report "xargs + GNU touch"           xargs -a "$DIR/list" touch -d '2022-01-01 12:00:00'
+report "smash, one touch per file"   smash_lines "$DIR/per_file"
+report "smash, touch -f list"        smash_lines <(echo "touch -f $DIR/list 01.5:00:12:01:01:2022")
+report "smash, touch glob"           smash_lines <(echo "touch $DIR/tree/*.o 02:00:12:01:01:2022")
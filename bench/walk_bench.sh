@@ -0,0 +1,60 @@
+#!/bin/bash
+# time of the smash walk built-in against find (run by bash, and by the smash as an external
+# command) over a generated tree, for a name-only scan, a scan that has to stat every entry
+# and a walk feeding the bulk touch.
+# usage: bench/walk_bench.sh [dirs] [files-per-dir] [runs]   (run from the repository root, after "make smash")
+SMASH=${SMASH:-./smash}
+DIRS=${1:-400}
+FILES=${2:-250}
+RUNS=${3:-3}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# DIRS directories, 4 levels deep, FILES files each (a tenth of them .gz)
+for ((d = 0; d < DIRS; d++)); do
+  sub="$DIR/tree/l$((d % 4))/m$((d % 20))/n$((d % 100))/d$d"
+  mkdir -p "$sub"
+  (cd "$sub" && for ((f = 0; f < FILES; f++)); do
+    if ((f % 10 == 0)); then echo -n "f$f.gz "; else echo -n "f$f.log "; fi
+  done | xargs touch)
+done
+TOTAL=$((DIRS * FILES))
+
+# best of RUNS wall time (ns) of: bash -c "$1" when $2 is "bash", or the smash reading $1
+best_ns() {
+  local best=0
+  for ((i = 0; i < RUNS; i++)); do
+    local start=$(date +%s%N)
+    if [ "$2" = bash ]; then
+      bash -c "$1" > "$DIR/out"
+    else
+      printf '%s\nquit\n' "$1" | "$SMASH" > "$DIR/out"
+    fi
+    local took=$(($(date +%s%N) - start))
+    if [ $best -eq 0 ] || [ $took -lt $best ]; then best=$took; fi
+  done
+  echo $best
+}
+
+report() {
+  local ns=$(best_ns "$2" "$3")
+  awk -v name="$1" -v files=$TOTAL -v ns=$ns 'BEGIN { printf "%-44s %10.0f entries/s  (%d ms)\n", name, files * 1e9 / ns, ns / 1e6 }'
+}
+
+# the same paths have to be found before the speed matters
+expected=$(find "$DIR/tree" -name '*.gz' | sort | md5sum)
+got=$(printf 'walk %s -name *.gz\nquit\n' "$DIR/tree" | "$SMASH" | sed -e 's/^smash> //' -e '/^smash> *$/d' | sort | md5sum)
+if [ "$expected" != "$got" ]; then
+  echo "walk built-in found other paths than find"
+  exit 1
+fi
+
+echo "tree walk, ${TOTAL} files in ${DIRS} directories, $(nproc) cpus, best of ${RUNS}"
+report "-name   bash  find"          "find $DIR/tree -name '*.gz'" bash
+report "-name   smash find"          "find $DIR/tree -name *.gz" smash
+report "-name   smash walk built-in" "walk $DIR/tree -name *.gz" smash
+report "-mtime  bash  find"          "find $DIR/tree -mtime -1" bash
+report "-mtime  smash find"          "find $DIR/tree -mtime -1" smash
+report "-mtime  smash walk built-in" "walk $DIR/tree -mtime -1" smash
+report "touch   bash  find | xargs touch"  "find $DIR/tree -name '*.gz' -print0 | xargs -0 touch -d '2000-01-01 00:00:00'" bash
+report "touch   smash walk -touch"         "walk $DIR/tree -name *.gz -touch 00:00:00:01:01:2000" smash
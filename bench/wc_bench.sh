@@ -0,0 +1,56 @@
+#!/bin/bash
+# throughput of the smash wc built-in against /usr/bin/wc (run by bash, and by the smash as an
+# external command) on a text file, for line counts, full counts and input from a pipe.
+# usage: bench/wc_bench.sh [size-in-MB] [runs]   (run from the repository root, after "make smash")
+SMASH=${SMASH:-./smash}
+SIZE_MB=${1:-256}
+RUNS=${2:-3}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# log-like lines of random words, repeated up to the wanted size
+base64 -w 0 < /dev/urandom | head -c 4000000 | fold -w 60 | sed 's/[+/]/ /g' > "$DIR/chunk"
+while [ $(stat -c %s "$DIR/chunk") -lt $((SIZE_MB * 1024 * 1024)) ]; do
+  cat "$DIR/chunk" "$DIR/chunk" > "$DIR/chunk2" && mv "$DIR/chunk2" "$DIR/chunk"
+done
+head -c $((SIZE_MB * 1024 * 1024)) "$DIR/chunk" > "$DIR/in"
+rm -f "$DIR/chunk"
+
+# best of RUNS wall time (ns) of: bash -c "$1" when $2 is "bash", or the smash reading $1
+best_ns() {
+  local best=0
+  for ((i = 0; i < RUNS; i++)); do
+    local start=$(date +%s%N)
+    if [ "$2" = bash ]; then
+      bash -c "$1" > /dev/null
+    else
+      printf '%s\nquit\n' "$1" | "$SMASH" > /dev/null
+    fi
+    local took=$(($(date +%s%N) - start))
+    if [ $best -eq 0 ] || [ $took -lt $best ]; then best=$took; fi
+  done
+  echo $best
+}
+
+report() {
+  local ns=$(best_ns "$2" "$3")
+  awk -v name="$1" -v mb=$SIZE_MB -v ns=$ns 'BEGIN { printf "%-40s %8.1f MB/s  (%d ms)\n", name, mb * 1e9 / ns, ns / 1e6 }'
+}
+
+# the counts have to agree before the speed matters
+expected=$(/usr/bin/wc < "$DIR/in" | awk '{ print $1, $2, $3 }')
+got=$(printf 'cat %s | wc\nquit\n' "$DIR/in" | "$SMASH" | sed 's/^smash> //' | awk 'NR == 1 { print $1, $2, $3 }')
+if [ "$expected" != "$got" ]; then
+  echo "wc built-in counts differ: expected '$expected', got '$got'"
+  exit 1
+fi
+
+echo "wc throughput, ${SIZE_MB} MB, $(nproc) cpus, best of ${RUNS}"
+report "wc -l  bash  /usr/bin/wc"      "/usr/bin/wc -l $DIR/in" bash
+report "wc -l  smash /usr/bin/wc"      "/usr/bin/wc -l $DIR/in" smash
+report "wc -l  smash wc built-in"      "wc -l $DIR/in" smash
+report "wc     bash  /usr/bin/wc"      "/usr/bin/wc $DIR/in" bash
+report "wc     smash /usr/bin/wc"      "/usr/bin/wc $DIR/in" smash
+report "wc     smash wc built-in"      "wc $DIR/in" smash
+report "pipe   smash cat | /usr/bin/wc -l" "cat $DIR/in | /usr/bin/wc -l" smash
+report "pipe   smash cat | wc -l built-in" "cat $DIR/in | wc -l" smash
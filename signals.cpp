@@ -1,5 +1,6 @@
 #include <iostream>
 #include <signal.h>
+#include <errno.h>
 #include "signals.h"
 #include "Commands.h"
 
@@ -10,6 +11,7 @@ void ctrlZHandler(int sig_num) {
 
   SmallShell& smash = SmallShell::getInstance();
   pid_t curr_pid = smash.getCurrentPid();
+  smash.getTracer().instant("SIGTSTP", "pid", curr_pid);
 
   JobsList* s_jobs_list = smash.getJobsList(); 
 
@@ -40,7 +42,9 @@ void ctrlCHandler(int sig_num)
 {
 	std::cout << "smash: got ctrl-C" << std::endl;
   SmallShell& smash = SmallShell::getInstance();
+  smash.addInterrupt();
   pid_t curr_pid= smash.getCurrentPid();
+  smash.getTracer().instant("SIGINT", "pid", curr_pid);
   if (curr_pid != -1 && (kill(curr_pid,0) == 0))
   {
     if(kill(curr_pid,SIGKILL) == -1)
@@ -50,41 +54,35 @@ void ctrlCHandler(int sig_num)
     }
     std::cout << "smash: process " << curr_pid << " was killed" << std::endl;
     smash.setCurrentPid(-1);
-    smash.getJobsList()->removeJobByPid(curr_pid);
+    smash.getJobsList()->removeKilledJob(curr_pid);
+  }
+  else if (smash.getForegroundBuiltIn() != nullptr) // built-ins stop at their next cancellation point
+  {
+    smash.getForegroundBuiltIn()->cancel();
   }
 }
 
 void alarmHandler (int sig_num, siginfo_t *info, void *ucontext)
 {
   std::cout << "smash: got an alarm" << std::endl;
-  pid_t bro_pid = info->si_pid; //bro_pid = pid of the alarm sending procces
-
   SmallShell& smash = SmallShell::getInstance();
-  JobsList* jobs_list = smash.getJobsList();
-
-  TimedList& s_list = smash.getTimedList(); 
-  TimedList::TimedEntry& entry = s_list.getTimedEntryByPid(bro_pid);
-  pid_t to_kill = entry.getPidToKill();
-
-  
-  //print only if procces was running while alarm was given
-  //if its a foreground procces and running time is 0 = the alarm was set before the procces had finished - a valid case of printing
-  //if its a background procces we check if it still exists in the joblist while getting the alarm -(was running when got the alarm) a valid case of printing
-  jobs_list->removeFinishedJobs();
-  if (entry.getRunningTime() == entry.getDuration() || entry.getRunningTime() == 0 || (entry.getRunningTime() == -1 && jobs_list->getJobByPid(to_kill) != nullptr)) 
-  { 
-    if (kill(to_kill, 0) != 0){ //process doesn't exist - do nothing
-    return; 
-    }
-    if (kill(to_kill, SIGKILL) == -1){
-    perror("smash error: kill failed");
+  smash.getTracer().instant("SIGALRM", "timer", info->si_value.sival_int);
+  if (info->si_code != SI_TIMER) // only the timers of timeout commands are expected
+  {
     return;
-    }
-    std::cout << "smash: " << entry.getCmdToKill() << " timed out!" << std::endl;
   }
-  
-  //process was killed, remove it from jobsList and timedList
-  s_list.removeTimedEntry(bro_pid);
-  jobs_list->removeJobByPid(to_kill);
 
+  //a background command that is already done is reaped here, which finishes its entry - then
+  //it is not timed out. else its process group gets SIGTERM now and SIGKILL after the grace
+  smash.getJobsList()->removeFinishedJobs();
+  smash.getTimedList().expire(info->si_value.sival_int);
+}
+
+void childHandler(int sig_num)
+{
+  // only notes when timed commands exited, for their elapsed time. they are reaped (and their
+  // entries finished) later, by whoever waits for them
+  int saved_errno = errno;
+  SmallShell::getInstance().getTimedList().noteEnded();
+  errno = saved_errno;
 }
@@ -4,5 +4,6 @@
 void ctrlZHandler(int sig_num);
 void ctrlCHandler(int sig_num);
 void alarmHandler(int sig_num, siginfo_t *info, void *ucontext);
+void childHandler(int sig_num);
 
 #endif //SMASH__SIGNALS_H_
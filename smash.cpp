@@ -11,8 +11,15 @@ int main(int argc, char* argv[]) {
     
     sa.sa_sigaction = alarmHandler; 
     sigisemptyset(&sa.sa_mask);
+    sigaddset(&sa.sa_mask, SIGCHLD); // both handlers look at the timed list
     sa.sa_flags = SA_RESTART | SA_SIGINFO; 
 
+    struct sigaction child_sa = {0};
+    child_sa.sa_handler = childHandler;
+    sigemptyset(&child_sa.sa_mask);
+    sigaddset(&child_sa.sa_mask, SIGALRM);
+    child_sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+
     if(signal(SIGTSTP , ctrlZHandler)==SIG_ERR) {
         perror("smash error: failed to set ctrl-Z handler");
     }
@@ -22,6 +29,9 @@ int main(int argc, char* argv[]) {
     if(sigaction(SIGALRM, &sa, nullptr) == -1){
         perror("smash error: failed to set alarm handler");
     }
+    if(sigaction(SIGCHLD, &child_sa, nullptr) == -1){
+        perror("smash error: failed to set child handler");
+    }
 
     SmallShell& smash = SmallShell::getInstance();
     smash.setCurrentPid(-1);
@@ -30,6 +40,7 @@ int main(int argc, char* argv[]) {
         std::cout << smash.getPrompt();
         std::string cmd_line;
         std::getline(std::cin, cmd_line);
+        smash.getTracer().instant("read line", nullptr, 0, cmd_line.c_str());
         smash.executeCommand(cmd_line.c_str());
     }
     return 0;